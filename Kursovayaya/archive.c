@@ -0,0 +1,951 @@
+/**
+ * @file archive.c
+ * @brief База данных репозитория - сжатый поколоночный архив
+ * @author Костопраев Дмитрий Евгеньевич
+ *
+ * Формат файла:
+ *   "RPA2", uint32 длина словаря, словарь (имена направлений, совместимостей, хосты сайтов);
+ *   блоки по ARCHIVE_BLOCK_SIZE записей, каждый декодируется независимо;
+ *   необязательная секция скетчей (sketches_encode) между последним блоком и индексом;
+ *   индекс блоков (смещение, длина, число записей, CRC32, зона min/max блока),
+ *   uint32 CRC32 индекса, uint32 число блоков, uint64 смещение индекса, "RPAE".
+ *
+ * Колонки блока: байт перечислений (направление | совместимость << 4), номера хостов,
+ * остатки адресов сайтов, названия, даты (зигзаг-разности номеров дней), размеры, зависимости.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "repository.h"
+
+#define ARCHIVE_MAGIC "RPA2"
+#define ARCHIVE_END_MAGIC "RPAE"
+#define ARCHIVE_TAIL_SIZE 20
+#define ARCHIVE_INDEX_ENTRY_SIZE (20 + 8 * FIELD_COUNT + 2)
+
+typedef struct {
+    unsigned long long offset;
+    unsigned int length;
+    unsigned int count;
+    unsigned int crc;
+    int first_record;
+} ArchiveBlock;
+
+/* Словарь хостов: строки плюс хеш-таблица с открытой адресацией */
+typedef struct {
+    char (*hosts)[MAX_LONG_STR];
+    int count;
+    int capacity;
+    int* table;
+    int table_size;
+} HostDict;
+
+typedef struct {
+    const unsigned char* data;
+    const ArchiveBlock* blocks;
+    int first;
+    int last;
+    Repository* records;
+    const Direction* dir_map;
+    int dir_count;
+    const Compatibility* compat_map;
+    int compat_count;
+    const HostDict* dict;
+    int ok;
+} DecodeTask;
+
+/* Таблица CRC32 (полином 0xEDB88320) постоянна: потоки сохранения и загрузки читают её без блокировок */
+static const unsigned int crc_table[256] = {
+    0x00000000u, 0x77073096u, 0xEE0E612Cu, 0x990951BAu, 0x076DC419u, 0x706AF48Fu,
+    0xE963A535u, 0x9E6495A3u, 0x0EDB8832u, 0x79DCB8A4u, 0xE0D5E91Eu, 0x97D2D988u,
+    0x09B64C2Bu, 0x7EB17CBDu, 0xE7B82D07u, 0x90BF1D91u, 0x1DB71064u, 0x6AB020F2u,
+    0xF3B97148u, 0x84BE41DEu, 0x1ADAD47Du, 0x6DDDE4EBu, 0xF4D4B551u, 0x83D385C7u,
+    0x136C9856u, 0x646BA8C0u, 0xFD62F97Au, 0x8A65C9ECu, 0x14015C4Fu, 0x63066CD9u,
+    0xFA0F3D63u, 0x8D080DF5u, 0x3B6E20C8u, 0x4C69105Eu, 0xD56041E4u, 0xA2677172u,
+    0x3C03E4D1u, 0x4B04D447u, 0xD20D85FDu, 0xA50AB56Bu, 0x35B5A8FAu, 0x42B2986Cu,
+    0xDBBBC9D6u, 0xACBCF940u, 0x32D86CE3u, 0x45DF5C75u, 0xDCD60DCFu, 0xABD13D59u,
+    0x26D930ACu, 0x51DE003Au, 0xC8D75180u, 0xBFD06116u, 0x21B4F4B5u, 0x56B3C423u,
+    0xCFBA9599u, 0xB8BDA50Fu, 0x2802B89Eu, 0x5F058808u, 0xC60CD9B2u, 0xB10BE924u,
+    0x2F6F7C87u, 0x58684C11u, 0xC1611DABu, 0xB6662D3Du, 0x76DC4190u, 0x01DB7106u,
+    0x98D220BCu, 0xEFD5102Au, 0x71B18589u, 0x06B6B51Fu, 0x9FBFE4A5u, 0xE8B8D433u,
+    0x7807C9A2u, 0x0F00F934u, 0x9609A88Eu, 0xE10E9818u, 0x7F6A0DBBu, 0x086D3D2Du,
+    0x91646C97u, 0xE6635C01u, 0x6B6B51F4u, 0x1C6C6162u, 0x856530D8u, 0xF262004Eu,
+    0x6C0695EDu, 0x1B01A57Bu, 0x8208F4C1u, 0xF50FC457u, 0x65B0D9C6u, 0x12B7E950u,
+    0x8BBEB8EAu, 0xFCB9887Cu, 0x62DD1DDFu, 0x15DA2D49u, 0x8CD37CF3u, 0xFBD44C65u,
+    0x4DB26158u, 0x3AB551CEu, 0xA3BC0074u, 0xD4BB30E2u, 0x4ADFA541u, 0x3DD895D7u,
+    0xA4D1C46Du, 0xD3D6F4FBu, 0x4369E96Au, 0x346ED9FCu, 0xAD678846u, 0xDA60B8D0u,
+    0x44042D73u, 0x33031DE5u, 0xAA0A4C5Fu, 0xDD0D7CC9u, 0x5005713Cu, 0x270241AAu,
+    0xBE0B1010u, 0xC90C2086u, 0x5768B525u, 0x206F85B3u, 0xB966D409u, 0xCE61E49Fu,
+    0x5EDEF90Eu, 0x29D9C998u, 0xB0D09822u, 0xC7D7A8B4u, 0x59B33D17u, 0x2EB40D81u,
+    0xB7BD5C3Bu, 0xC0BA6CADu, 0xEDB88320u, 0x9ABFB3B6u, 0x03B6E20Cu, 0x74B1D29Au,
+    0xEAD54739u, 0x9DD277AFu, 0x04DB2615u, 0x73DC1683u, 0xE3630B12u, 0x94643B84u,
+    0x0D6D6A3Eu, 0x7A6A5AA8u, 0xE40ECF0Bu, 0x9309FF9Du, 0x0A00AE27u, 0x7D079EB1u,
+    0xF00F9344u, 0x8708A3D2u, 0x1E01F268u, 0x6906C2FEu, 0xF762575Du, 0x806567CBu,
+    0x196C3671u, 0x6E6B06E7u, 0xFED41B76u, 0x89D32BE0u, 0x10DA7A5Au, 0x67DD4ACCu,
+    0xF9B9DF6Fu, 0x8EBEEFF9u, 0x17B7BE43u, 0x60B08ED5u, 0xD6D6A3E8u, 0xA1D1937Eu,
+    0x38D8C2C4u, 0x4FDFF252u, 0xD1BB67F1u, 0xA6BC5767u, 0x3FB506DDu, 0x48B2364Bu,
+    0xD80D2BDAu, 0xAF0A1B4Cu, 0x36034AF6u, 0x41047A60u, 0xDF60EFC3u, 0xA867DF55u,
+    0x316E8EEFu, 0x4669BE79u, 0xCB61B38Cu, 0xBC66831Au, 0x256FD2A0u, 0x5268E236u,
+    0xCC0C7795u, 0xBB0B4703u, 0x220216B9u, 0x5505262Fu, 0xC5BA3BBEu, 0xB2BD0B28u,
+    0x2BB45A92u, 0x5CB36A04u, 0xC2D7FFA7u, 0xB5D0CF31u, 0x2CD99E8Bu, 0x5BDEAE1Du,
+    0x9B64C2B0u, 0xEC63F226u, 0x756AA39Cu, 0x026D930Au, 0x9C0906A9u, 0xEB0E363Fu,
+    0x72076785u, 0x05005713u, 0x95BF4A82u, 0xE2B87A14u, 0x7BB12BAEu, 0x0CB61B38u,
+    0x92D28E9Bu, 0xE5D5BE0Du, 0x7CDCEFB7u, 0x0BDBDF21u, 0x86D3D2D4u, 0xF1D4E242u,
+    0x68DDB3F8u, 0x1FDA836Eu, 0x81BE16CDu, 0xF6B9265Bu, 0x6FB077E1u, 0x18B74777u,
+    0x88085AE6u, 0xFF0F6A70u, 0x66063BCAu, 0x11010B5Cu, 0x8F659EFFu, 0xF862AE69u,
+    0x616BFFD3u, 0x166CCF45u, 0xA00AE278u, 0xD70DD2EEu, 0x4E048354u, 0x3903B3C2u,
+    0xA7672661u, 0xD06016F7u, 0x4969474Du, 0x3E6E77DBu, 0xAED16A4Au, 0xD9D65ADCu,
+    0x40DF0B66u, 0x37D83BF0u, 0xA9BCAE53u, 0xDEBB9EC5u, 0x47B2CF7Fu, 0x30B5FFE9u,
+    0xBDBDF21Cu, 0xCABAC28Au, 0x53B39330u, 0x24B4A3A6u, 0xBAD03605u, 0xCDD70693u,
+    0x54DE5729u, 0x23D967BFu, 0xB3667A2Eu, 0xC4614AB8u, 0x5D681B02u, 0x2A6F2B94u,
+    0xB40BBE37u, 0xC30C8EA1u, 0x5A05DF1Bu, 0x2D02EF8Du
+};
+
+unsigned int crc32_compute(const unsigned char* data, size_t size)
+{
+    unsigned int crc = 0xFFFFFFFFu;
+    size_t i;
+    
+    for (i = 0; i < size; i++) {
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+/* Номер дня от 01.01.1900, даты близки друг к другу и дают малые разности */
+static long date_to_days(Date date)
+{
+    long y = date.year;
+    long m = date.month;
+    long era;
+    long yoe;
+    long doy;
+    
+    if (m <= 2) {
+        y--;
+    }
+    era = y / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + date.day - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 693901;
+}
+
+static Date days_to_date(long days)
+{
+    Date date;
+    long z = days + 693901;
+    long era = z / 146097;
+    long doe = z - era * 146097;
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    
+    date.day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    date.month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    date.year = (int)(yoe + era * 400 + (date.month <= 2));
+    return date;
+}
+
+static unsigned long zigzag_encode(long value)
+{
+    return value < 0 ? ((unsigned long)(-(value + 1)) << 1) | 1 : (unsigned long)value << 1;
+}
+
+static long zigzag_decode(unsigned long value)
+{
+    return (value & 1) ? -(long)(value >> 1) - 1 : (long)(value >> 1);
+}
+
+/* Длина хоста в адресе сайта: схема и имя до первого '/' после "://" */
+int site_host_length(const char* site)
+{
+    const char* scheme = strstr(site, "://");
+    const char* slash;
+    
+    if (scheme == NULL) {
+        return 0;
+    }
+    
+    slash = strchr(scheme + 3, '/');
+    return slash != NULL ? (int)(slash - site) : (int)strlen(site);
+}
+
+static unsigned long hash_bytes(const char* data, int length)
+{
+    unsigned long hash = 2166136261u;
+    int i;
+    
+    for (i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void host_dict_free(HostDict* dict)
+{
+    free(dict->hosts);
+    free(dict->table);
+    dict->hosts = NULL;
+    dict->table = NULL;
+    dict->count = 0;
+    dict->capacity = 0;
+    dict->table_size = 0;
+}
+
+static int host_dict_init(HostDict* dict, int expected)
+{
+    dict->count = 0;
+    dict->capacity = INITIAL_CAPACITY;
+    dict->table_size = 16;
+    while (dict->table_size < expected * 2) {
+        dict->table_size *= 2;
+    }
+    
+    dict->hosts = (char (*)[MAX_LONG_STR])malloc(dict->capacity * MAX_LONG_STR);
+    dict->table = (int*)malloc(dict->table_size * sizeof(int));
+    if (dict->hosts == NULL || dict->table == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для словаря хостов\n");
+        host_dict_free(dict);
+        return 0;
+    }
+    
+    memset(dict->table, -1, dict->table_size * sizeof(int));
+    return 1;
+}
+
+/* Удвоить хеш-таблицу, чтобы заполнение не превышало половины */
+static int host_dict_rehash(HostDict* dict)
+{
+    int new_size = dict->table_size * 2;
+    int* table;
+    unsigned long slot;
+    int id;
+    
+    table = (int*)malloc(new_size * sizeof(int));
+    if (table == NULL) {
+        fprintf(stderr, "Ошибка расширения словаря хостов\n");
+        return 0;
+    }
+    memset(table, -1, new_size * sizeof(int));
+    
+    for (id = 0; id < dict->count; id++) {
+        slot = hash_bytes(dict->hosts[id], (int)strlen(dict->hosts[id])) & (new_size - 1);
+        while (table[slot] >= 0) {
+            slot = (slot + 1) & (new_size - 1);
+        }
+        table[slot] = id;
+    }
+    
+    free(dict->table);
+    dict->table = table;
+    dict->table_size = new_size;
+    return 1;
+}
+
+/* Номер хоста в словаре; новый хост добавляется. -1 при нехватке памяти */
+static int host_dict_intern(HostDict* dict, const char* host, int length)
+{
+    unsigned long slot;
+    char (*temp)[MAX_LONG_STR];
+    int id;
+    
+    if ((dict->count + 1) * 2 > dict->table_size && !host_dict_rehash(dict)) {
+        return -1;
+    }
+    
+    slot = hash_bytes(host, length) & (dict->table_size - 1);
+    
+    while ((id = dict->table[slot]) >= 0) {
+        if ((int)strlen(dict->hosts[id]) == length && memcmp(dict->hosts[id], host, length) == 0) {
+            return id;
+        }
+        slot = (slot + 1) & (dict->table_size - 1);
+    }
+    
+    if (dict->count >= dict->capacity) {
+        temp = (char (*)[MAX_LONG_STR])realloc(dict->hosts, dict->capacity * 2 * MAX_LONG_STR);
+        if (temp == NULL) {
+            fprintf(stderr, "Ошибка расширения словаря хостов\n");
+            return -1;
+        }
+        dict->hosts = temp;
+        dict->capacity *= 2;
+    }
+    
+    id = dict->count++;
+    memcpy(dict->hosts[id], host, length);
+    dict->hosts[id][length] = '\0';
+    dict->table[slot] = id;
+    return id;
+}
+
+static int put_string(Buffer* buf, const char* str, int length)
+{
+    return buffer_put_varint(buf, (unsigned long)length) && buffer_put(buf, str, length);
+}
+
+static int get_string(const unsigned char** p, const unsigned char* end, char* dest, int size)
+{
+    unsigned long length;
+    
+    if (!buffer_get_varint(p, end, &length) || length >= (unsigned long)size ||
+        length > (unsigned long)(end - *p)) {
+        return 0;
+    }
+    
+    memcpy(dest, *p, length);
+    dest[length] = '\0';
+    *p += length;
+    return 1;
+}
+
+static int encode_dictionary(Buffer* buf, const HostDict* dict)
+{
+    int i;
+    
+    if (!buffer_put_varint(buf, DIRECTION_COUNT)) {
+        return 0;
+    }
+    for (i = 0; i < DIRECTION_COUNT; i++) {
+        if (!put_string(buf, dir_names[i], (int)strlen(dir_names[i]))) {
+            return 0;
+        }
+    }
+    
+    if (!buffer_put_varint(buf, COMPAT_COUNT)) {
+        return 0;
+    }
+    for (i = 0; i < COMPAT_COUNT; i++) {
+        if (!put_string(buf, compat_names[i], (int)strlen(compat_names[i]))) {
+            return 0;
+        }
+    }
+    
+    if (!buffer_put_varint(buf, (unsigned long)dict->count)) {
+        return 0;
+    }
+    for (i = 0; i < dict->count; i++) {
+        if (!put_string(buf, dict->hosts[i], (int)strlen(dict->hosts[i]))) {
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+static int encode_block(Buffer* buf, const Repository* records, const int* host_ids, int count)
+{
+    long prev_days = 0;
+    long days;
+    int host_length;
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        unsigned char codes = (unsigned char)(records[i].direction | (records[i].compatibility << 4));
+        if (!buffer_put(buf, &codes, 1)) {
+            return 0;
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!buffer_put_varint(buf, (unsigned long)host_ids[i])) {
+            return 0;
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        host_length = site_host_length(records[i].site);
+        if (!put_string(buf, records[i].site + host_length,
+                        (int)strlen(records[i].site) - host_length)) {
+            return 0;
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!put_string(buf, records[i].name, (int)strlen(records[i].name))) {
+            return 0;
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        days = date_to_days(records[i].release_date);
+        if (!buffer_put_varint(buf, zigzag_encode(days - prev_days))) {
+            return 0;
+        }
+        prev_days = days;
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!buffer_put_varint(buf, (unsigned long)records[i].size)) {
+            return 0;
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!buffer_put_varint(buf, (unsigned long)records[i].dependencies)) {
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+static int write_u32(FILE* file, unsigned int value)
+{
+    return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+static int write_u64(FILE* file, unsigned long long value)
+{
+    return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+/* Зона блока в индексе: min и max каждого поля, затем маски перечислений */
+static int put_zone(Buffer* buf, const ZoneMap* zone)
+{
+    int f;
+    
+    for (f = 0; f < FIELD_COUNT; f++) {
+        if (!buffer_put(buf, &zone->min[f], 4) || !buffer_put(buf, &zone->max[f], 4)) {
+            return 0;
+        }
+    }
+    
+    return buffer_put(buf, &zone->direction_mask, 1) && buffer_put(buf, &zone->compat_mask, 1);
+}
+
+/* Следующая живая запись версии начиная с позиции *index; NULL в конце */
+static const Repository* next_live_record(const DBSnapshot* snapshot, int* index)
+{
+    const Repository* record;
+    
+    while (*index < snapshot->count) {
+        record = snapshot_record(snapshot, (*index)++);
+        if (record != NULL) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Записать версию таблицы в открытый файл. Удалённые записи пропускаются,
+ * поэтому зоны блоков архива строятся заново по записанным записям.
+ */
+int snapshot_write_archive(DBSnapshot* snapshot, FILE* file, SaveProgress* progress)
+{
+    HostDict dict;
+    Buffer buf = { NULL, 0, 0, 0 };
+    ArchiveBlock* blocks = NULL;
+    ZoneMap* zones = NULL;
+    Repository* staged = NULL;
+    RepositorySketches* sketches = NULL;
+    const Repository* record;
+    int* host_ids = NULL;
+    unsigned long long offset;
+    int live_count = 0;
+    int block_count;
+    int first;
+    int count;
+    int position;
+    int b, i;
+    int ok = 0;
+    
+    if (snapshot == NULL || file == NULL) {
+        fprintf(stderr, "Ошибка: некорректные параметры в snapshot_write_archive\n");
+        return 0;
+    }
+    
+    position = 0;
+    while (next_live_record(snapshot, &position) != NULL) {
+        live_count++;
+    }
+    
+    if (live_count == 0) {
+        fprintf(stderr, "Нет данных для сохранения\n");
+        return 0;
+    }
+    
+    block_count = (live_count + ARCHIVE_BLOCK_SIZE - 1) / ARCHIVE_BLOCK_SIZE;
+    
+    if (!host_dict_init(&dict, live_count < 1024 ? live_count : 1024)) {
+        return 0;
+    }
+    
+    host_ids = (int*)malloc(live_count * sizeof(int));
+    blocks = (ArchiveBlock*)malloc(block_count * sizeof(ArchiveBlock));
+    zones = (ZoneMap*)malloc(block_count * sizeof(ZoneMap));
+    staged = (Repository*)malloc(ARCHIVE_BLOCK_SIZE * sizeof(Repository));
+    sketches = (RepositorySketches*)calloc(1, sizeof(RepositorySketches));
+    if (host_ids == NULL || blocks == NULL || zones == NULL || staged == NULL || sketches == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для архива\n");
+        goto cleanup;
+    }
+    
+    position = 0;
+    for (i = 0; i < live_count; i++) {
+        record = next_live_record(snapshot, &position);
+        host_ids[i] = host_dict_intern(&dict, record->site, site_host_length(record->site));
+        if (host_ids[i] < 0) {
+            goto cleanup;
+        }
+    }
+    
+    if (!encode_dictionary(&buf, &dict) ||
+        fwrite(ARCHIVE_MAGIC, 1, 4, file) != 4 ||
+        !write_u32(file, (unsigned int)buf.length) ||
+        fwrite(buf.data, 1, buf.length, file) != buf.length) {
+        fprintf(stderr, "Ошибка записи заголовка архива\n");
+        goto cleanup;
+    }
+    offset = 8 + buf.length;
+    
+    position = 0;
+    for (b = 0; b < block_count; b++) {
+        first = b * ARCHIVE_BLOCK_SIZE;
+        count = live_count - first < ARCHIVE_BLOCK_SIZE ? live_count - first : ARCHIVE_BLOCK_SIZE;
+        
+        for (i = 0; i < count; i++) {
+            staged[i] = *next_live_record(snapshot, &position);
+            sketches_add(sketches, &staged[i]);
+        }
+        zone_build(&zones[b], staged, count);
+        
+        buf.length = 0;
+        if (!encode_block(&buf, staged, &host_ids[first], count) ||
+            fwrite(buf.data, 1, buf.length, file) != buf.length) {
+            fprintf(stderr, "Ошибка записи блока %d архива\n", b);
+            goto cleanup;
+        }
+        
+        blocks[b].offset = offset;
+        blocks[b].length = (unsigned int)buf.length;
+        blocks[b].count = (unsigned int)count;
+        blocks[b].crc = crc32_compute(buf.data, buf.length);
+        offset += buf.length;
+        
+        if (progress != NULL) {
+            progress->written = position;
+        }
+    }
+    
+    /* Скетчи построены по записанным записям и при загрузке не пересчитываются */
+    buf.length = 0;
+    if (!sketches_encode(&buf, sketches) || fwrite(buf.data, 1, buf.length, file) != buf.length) {
+        fprintf(stderr, "Ошибка записи скетчей архива\n");
+        goto cleanup;
+    }
+    offset += buf.length;
+    
+    buf.length = 0;
+    for (b = 0; b < block_count; b++) {
+        if (!buffer_put(&buf, &blocks[b].offset, 8) || !buffer_put(&buf, &blocks[b].length, 4) ||
+            !buffer_put(&buf, &blocks[b].count, 4) || !buffer_put(&buf, &blocks[b].crc, 4) ||
+            !put_zone(&buf, &zones[b])) {
+            goto cleanup;
+        }
+    }
+    
+    if (fwrite(buf.data, 1, buf.length, file) != buf.length ||
+        !write_u32(file, crc32_compute(buf.data, buf.length)) ||
+        !write_u32(file, (unsigned int)block_count) || !write_u64(file, offset) ||
+        fwrite(ARCHIVE_END_MAGIC, 1, 4, file) != 4) {
+        fprintf(stderr, "Ошибка записи индекса архива\n");
+        goto cleanup;
+    }
+    
+    ok = 1;
+
+cleanup:
+    buffer_free(&buf);
+    host_dict_free(&dict);
+    free(host_ids);
+    free(blocks);
+    free(zones);
+    free(staged);
+    free(sketches);
+    return ok;
+}
+
+static int decode_block(const DecodeTask* task, int b)
+{
+    const ArchiveBlock* block = &task->blocks[b];
+    const unsigned char* p = task->data + block->offset;
+    const unsigned char* end = p + block->length;
+    Repository* records = task->records + block->first_record;
+    int count = (int)block->count;
+    unsigned long value;
+    unsigned int dir_code;
+    unsigned int compat_code;
+    long days = 0;
+    int host_length;
+    int i;
+    
+    if (crc32_compute(p, block->length) != block->crc) {
+        fprintf(stderr, "Ошибка: блок %d архива повреждён (CRC)\n", b);
+        return 0;
+    }
+    
+    if (end - p < count) {
+        return 0;
+    }
+    for (i = 0; i < count; i++, p++) {
+        dir_code = *p & 0x0F;
+        compat_code = *p >> 4;
+        if ((int)dir_code >= task->dir_count || (int)compat_code >= task->compat_count) {
+            return 0;
+        }
+        records[i].direction = task->dir_map[dir_code];
+        records[i].compatibility = task->compat_map[compat_code];
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!buffer_get_varint(&p, end, &value) || value >= (unsigned long)task->dict->count) {
+            return 0;
+        }
+        strcpy(records[i].site, task->dict->hosts[value]);
+    }
+    
+    for (i = 0; i < count; i++) {
+        host_length = (int)strlen(records[i].site);
+        if (!get_string(&p, end, records[i].site + host_length, MAX_LONG_STR - host_length)) {
+            return 0;
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!get_string(&p, end, records[i].name, MAX_LONG_STR)) {
+            return 0;
+        }
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!buffer_get_varint(&p, end, &value)) {
+            return 0;
+        }
+        days += zigzag_decode(value);
+        records[i].release_date = days_to_date(days);
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!buffer_get_varint(&p, end, &value) || value == 0 || value > 0x7FFFFFFFul) {
+            return 0;
+        }
+        records[i].size = (int)value;
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!buffer_get_varint(&p, end, &value) || value > 0x7FFFFFFFul) {
+            return 0;
+        }
+        records[i].dependencies = (int)value;
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (!validate_date(records[i].release_date)) {
+            return 0;
+        }
+    }
+    
+    return p == end;
+}
+
+static int decode_blocks(void* arg)
+{
+    DecodeTask* task = (DecodeTask*)arg;
+    int b;
+    
+    task->ok = 1;
+    for (b = task->first; b < task->last; b++) {
+        if (!decode_block(task, b)) {
+            fprintf(stderr, "Ошибка в блоке %d архива: некорректные данные\n", b);
+            task->ok = 0;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static unsigned int get_u32(const unsigned char* p)
+{
+    unsigned int value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static unsigned long long get_u64(const unsigned char* p)
+{
+    unsigned long long value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static void read_zone(const unsigned char* p, ZoneMap* zone)
+{
+    int f;
+    
+    for (f = 0; f < FIELD_COUNT; f++) {
+        zone->min[f] = (int)get_u32(p + f * 8);
+        zone->max[f] = (int)get_u32(p + f * 8 + 4);
+    }
+    zone->direction_mask = p[FIELD_COUNT * 8];
+    zone->compat_mask = p[FIELD_COUNT * 8 + 1];
+}
+
+static int decode_dictionary(const unsigned char* p, const unsigned char* end,
+                             Direction* dir_map, int* dir_count,
+                             Compatibility* compat_map, int* compat_count, HostDict* dict)
+{
+    char name[MAX_LONG_STR];
+    unsigned long count;
+    unsigned long i;
+    
+    if (!buffer_get_varint(&p, end, &count) || count > 16) {
+        return 0;
+    }
+    *dir_count = (int)count;
+    for (i = 0; i < count; i++) {
+        if (!get_string(&p, end, name, MAX_LONG_STR) || !string_to_direction(name, &dir_map[i])) {
+            return 0;
+        }
+    }
+    
+    if (!buffer_get_varint(&p, end, &count) || count > 16) {
+        return 0;
+    }
+    *compat_count = (int)count;
+    for (i = 0; i < count; i++) {
+        if (!get_string(&p, end, name, MAX_LONG_STR) || !string_to_compatibility(name, &compat_map[i])) {
+            return 0;
+        }
+    }
+    
+    if (!buffer_get_varint(&p, end, &count) || count > (unsigned long)(end - p) ||
+        !host_dict_init(dict, 16)) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        if (!get_string(&p, end, name, MAX_LONG_STR) ||
+            host_dict_intern(dict, name, (int)strlen(name)) != (int)i) {
+            host_dict_free(dict);
+            return 0;
+        }
+    }
+    
+    return p == end;
+}
+
+int has_archive_extension(const char* filename)
+{
+    size_t length = strlen(filename);
+    size_t ext_length = strlen(ARCHIVE_EXTENSION);
+    
+    return length > ext_length && strcmp(filename + length - ext_length, ARCHIVE_EXTENSION) == 0;
+}
+
+/* Проверить, что файл начинается с сигнатуры архива */
+int is_archive_file(const char* filename)
+{
+    FILE* file;
+    char magic[4];
+    int result;
+    
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    
+    result = fread(magic, 1, 4, file) == 4 && memcmp(magic, ARCHIVE_MAGIC, 4) == 0;
+    fclose(file);
+    return result;
+}
+
+/*
+ * Загрузка архива: индекс читается из конца файла, блоки делятся между
+ * thread_count потоками и декодируются параллельно прямо на свои места
+ * в итоговом массиве. Записи с зонами и скетчами передаются в db, а если
+ * db равна NULL - только массив записей в list. При ошибке чтения или
+ * декодирования ни db, ни list не меняются (о нехватке памяти при замене
+ * записей в db см. db_replace_records).
+ */
+static int load_archive(const char* filename, int thread_count, RepositoryDB* db, RecordList* list)
+{
+    unsigned char* data;
+    size_t size;
+    const unsigned char* tail;
+    const unsigned char* entry;
+    unsigned long long index_offset;
+    unsigned int dict_length;
+    int block_count;
+    ArchiveBlock* blocks = NULL;
+    ZoneMap* zones = NULL;
+    int zones_aligned = 1;
+    RepositorySketches* sketches = NULL;
+    unsigned long long blocks_end;
+    Repository* records = NULL;
+    DecodeTask* tasks = NULL;
+    platform_thread* threads = NULL;
+    Direction dir_map[16];
+    Compatibility compat_map[16];
+    int dir_count;
+    int compat_count;
+    HostDict dict = { NULL, 0, 0, NULL, 0 };
+    long long total = 0;
+    int started = 0;
+    int b, t;
+    int ok = 0;
+    
+    data = read_whole_file(filename, &size);
+    if (data == NULL) {
+        return 0;
+    }
+    
+    if (size < 8 + ARCHIVE_TAIL_SIZE || memcmp(data, ARCHIVE_MAGIC, 4) != 0 ||
+        memcmp(data + size - 4, ARCHIVE_END_MAGIC, 4) != 0) {
+        fprintf(stderr, "Ошибка: файл не является архивом или обрезан\n");
+        free(data);
+        return 0;
+    }
+    
+    tail = data + size - ARCHIVE_TAIL_SIZE;
+    block_count = (int)get_u32(tail + 4);
+    index_offset = get_u64(tail + 8);
+    dict_length = get_u32(data + 4);
+    
+    if (block_count <= 0 || 8 + (unsigned long long)dict_length > index_offset ||
+        index_offset + (unsigned long long)block_count * ARCHIVE_INDEX_ENTRY_SIZE != size - ARCHIVE_TAIL_SIZE ||
+        crc32_compute(data + index_offset, size - ARCHIVE_TAIL_SIZE - index_offset) != get_u32(tail)) {
+        fprintf(stderr, "Ошибка: повреждён индекс архива\n");
+        free(data);
+        return 0;
+    }
+    
+    if (!decode_dictionary(data + 8, data + 8 + dict_length, dir_map, &dir_count,
+                           compat_map, &compat_count, &dict)) {
+        fprintf(stderr, "Ошибка: повреждён словарь архива\n");
+        host_dict_free(&dict);
+        free(data);
+        return 0;
+    }
+    
+    blocks = (ArchiveBlock*)malloc(block_count * sizeof(ArchiveBlock));
+    zones = (ZoneMap*)malloc(block_count * sizeof(ZoneMap));
+    if (blocks == NULL || zones == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для индекса архива\n");
+        goto cleanup;
+    }
+    
+    for (b = 0; b < block_count; b++) {
+        entry = data + index_offset + (size_t)b * ARCHIVE_INDEX_ENTRY_SIZE;
+        blocks[b].offset = get_u64(entry);
+        blocks[b].length = get_u32(entry + 8);
+        blocks[b].count = get_u32(entry + 12);
+        blocks[b].crc = get_u32(entry + 16);
+        blocks[b].first_record = (int)total;
+        total += blocks[b].count;
+        read_zone(entry + 20, &zones[b]);
+        
+        /* Зоны из индекса годятся, только если блоки архива совпадают с блоками зон */
+        if (b < block_count - 1 && blocks[b].count != ZONE_BLOCK_SIZE) {
+            zones_aligned = 0;
+        }
+        
+        if (blocks[b].offset < 8 + dict_length || blocks[b].offset + blocks[b].length > index_offset ||
+            blocks[b].count == 0 || blocks[b].count > ARCHIVE_BLOCK_SIZE || total > 0x7FFFFFFF) {
+            fprintf(stderr, "Ошибка: повреждён индекс архива (блок %d)\n", b);
+            goto cleanup;
+        }
+    }
+    
+    records = (Repository*)malloc((size_t)total * sizeof(Repository));
+    if (thread_count > block_count) {
+        thread_count = block_count;
+    }
+    tasks = (DecodeTask*)malloc(thread_count * sizeof(DecodeTask));
+    threads = (platform_thread*)malloc(thread_count * sizeof(platform_thread));
+    if (records == NULL || tasks == NULL || threads == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для загрузки архива\n");
+        goto cleanup;
+    }
+    
+    for (t = 0; t < thread_count; t++) {
+        tasks[t].data = data;
+        tasks[t].blocks = blocks;
+        tasks[t].first = (int)((long long)block_count * t / thread_count);
+        tasks[t].last = (int)((long long)block_count * (t + 1) / thread_count);
+        tasks[t].records = records;
+        tasks[t].dir_map = dir_map;
+        tasks[t].dir_count = dir_count;
+        tasks[t].compat_map = compat_map;
+        tasks[t].compat_count = compat_count;
+        tasks[t].dict = &dict;
+        tasks[t].ok = 0;
+    }
+    
+    /* Последний диапазон декодируется в текущем потоке */
+    for (t = 0; t < thread_count - 1; t++) {
+        if (!platform_thread_create(&threads[t], decode_blocks, &tasks[t])) {
+            break;
+        }
+        started++;
+    }
+    for (t = started; t < thread_count; t++) {
+        decode_blocks(&tasks[t]);
+    }
+    for (t = 0; t < started; t++) {
+        platform_thread_join(threads[t]);
+    }
+    
+    ok = 1;
+    for (t = 0; t < thread_count; t++) {
+        ok = ok && tasks[t].ok;
+    }
+    
+    if (ok && db == NULL) {
+        list->records = records;
+        list->count = (int)total;
+        list->capacity = (int)total;
+        records = NULL;
+    } else if (ok) {
+        /* Секция скетчей необязательна: без неё скетчи пересчитываются */
+        blocks_end = blocks[block_count - 1].offset + blocks[block_count - 1].length;
+        sketches = (RepositorySketches*)malloc(sizeof(RepositorySketches));
+        if (sketches != NULL &&
+            !sketches_decode(data + blocks_end, data + index_offset, sketches)) {
+            free(sketches);
+            sketches = NULL;
+        }
+        
+        ok = db_replace_records(db, records, (int)total, (int)total,
+                                zones_aligned ? zones : NULL, block_count, sketches);
+        records = NULL;
+    }
+
+cleanup:
+    host_dict_free(&dict);
+    free(records);
+    free(tasks);
+    free(threads);
+    free(blocks);
+    free(zones);
+    free(sketches);
+    free(data);
+    return ok;
+}
+
+int db_load_archive(RepositoryDB* db, const char* filename)
+{
+    if (db == NULL || filename == NULL) {
+        fprintf(stderr, "Ошибка: некорректные параметры в db_load_archive\n");
+        return 0;
+    }
+    
+    return load_archive(filename, platform_cpu_count(), db, NULL);
+}
+
+/* Прочитать записи архива в list в текущем потоке, без зон и скетчей */
+int read_archive_records(const char* filename, RecordList* list)
+{
+    return load_archive(filename, 1, NULL, list);
+}
@@ -0,0 +1,152 @@
+/**
+ * @file buffer.c
+ * @brief База данных репозитория - растущий байтовый буфер
+ * @author Костопраев Дмитрий Евгеньевич
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "repository.h"
+
+#define READ_FILE_PART ((size_t)1 << 30)
+
+int buffer_reserve(Buffer* buf, size_t extra)
+{
+    size_t needed = buf->length + extra;
+    size_t new_capacity;
+    unsigned char* temp;
+    
+    if (needed <= buf->capacity) {
+        return 1;
+    }
+    
+    new_capacity = (buf->capacity > 0) ? buf->capacity : 4096;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    
+    temp = (unsigned char*)realloc(buf->data, new_capacity);
+    if (temp == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для буфера\n");
+        return 0;
+    }
+    
+    buf->data = temp;
+    buf->capacity = new_capacity;
+    return 1;
+}
+
+int buffer_put(Buffer* buf, const void* data, size_t size)
+{
+    if (!buffer_reserve(buf, size)) {
+        return 0;
+    }
+    
+    memcpy(buf->data + buf->length, data, size);
+    buf->length += size;
+    return 1;
+}
+
+/* Число по 7 бит в байте, старший бит - признак продолжения */
+int buffer_put_varint(Buffer* buf, unsigned long value)
+{
+    unsigned char bytes[10];
+    int n = 0;
+    
+    while (value >= 0x80) {
+        bytes[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[n++] = (unsigned char)value;
+    
+    return buffer_put(buf, bytes, n);
+}
+
+int buffer_get_varint(const unsigned char** p, const unsigned char* end, unsigned long* value)
+{
+    unsigned long result = 0;
+    int shift = 0;
+    
+    while (*p < end && shift < 35) {
+        result |= (unsigned long)(**p & 0x7F) << shift;
+        if ((*(*p)++ & 0x80) == 0) {
+            *value = result;
+            return 1;
+        }
+        shift += 7;
+    }
+    
+    return 0;
+}
+
+/* Сдвинуть непрочитанный остаток в начало буфера */
+void buffer_compact(Buffer* buf)
+{
+    if (buf->offset == 0) {
+        return;
+    }
+    
+    memmove(buf->data, buf->data + buf->offset, buf->length - buf->offset);
+    buf->length -= buf->offset;
+    buf->offset = 0;
+}
+
+void buffer_free(Buffer* buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->length = 0;
+    buf->capacity = 0;
+    buf->offset = 0;
+}
+
+/* Прочитать файл целиком в память; size - число прочитанных байт */
+unsigned char* read_whole_file(const char* filename, size_t* size)
+{
+    FILE* file;
+    unsigned char* data;
+    long long length;
+    size_t done = 0;
+    size_t part;
+    
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        perror("Ошибка открытия файла");
+        return NULL;
+    }
+    
+    if (!platform_file_size(file, &length) || length < 0) {
+        perror("Ошибка чтения файла");
+        fclose(file);
+        return NULL;
+    }
+    if ((unsigned long long)length >= (size_t)-1) {
+        fprintf(stderr, "Ошибка: файл '%s' слишком велик для чтения в память\n", filename);
+        fclose(file);
+        return NULL;
+    }
+    
+    data = (unsigned char*)malloc(length > 0 ? (size_t)length : 1);
+    if (data == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для чтения файла\n");
+        fclose(file);
+        return NULL;
+    }
+    
+    /* Частями по READ_FILE_PART: fread в некоторых библиотеках не читает больше 2 Гб за вызов */
+    while (done < (size_t)length) {
+        part = (size_t)length - done < READ_FILE_PART ? (size_t)length - done : READ_FILE_PART;
+        if (fread(data + done, 1, part, file) != part) {
+            perror("Ошибка чтения файла");
+            free(data);
+            fclose(file);
+            return NULL;
+        }
+        done += part;
+    }
+    
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
@@ -0,0 +1,948 @@
+/**
+ * @file formats.c
+ * @brief База данных репозитория - импорт и экспорт CSV и JSON Lines
+ * @author Костопраев Дмитрий Евгеньевич
+ *
+ * Файл читается в память целиком и разбирается за один проход, побайтно.
+ * Поля без кавычек и escape-последовательностей не копируются, а
+ * разбираются прямо в данных файла в ячейку массива записей, выделенного
+ * заранее по числу строк. Поля обычно короче 16 байт, поэтому векторный
+ * поиск разделителей выигрыша не даёт: время уходит на преобразование
+ * полей и проверку записей. Ошибки сообщаются с номером строки и столбца
+ * (в байтах) начала поля.
+ *
+ * CSV: первая строка - заголовок с именами столбцов в любом порядке,
+ * поля по RFC 4180 (кавычки, удвоенная кавычка внутри, переводы строк
+ * внутри кавычек). JSON Lines: по объекту на строку, значения - строки
+ * и целые числа, неизвестные ключи с простыми значениями пропускаются.
+ * Даты в обоих форматах - ГГГГ-ММ-ДД (при чтении допускается и ДД.ММ.ГГГГ).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "repository.h"
+
+
+typedef enum {
+    COLUMN_DIRECTION = 0,
+    COLUMN_SITE,
+    COLUMN_NAME,
+    COLUMN_SIZE,
+    COLUMN_RELEASE_DATE,
+    COLUMN_DEPENDENCIES,
+    COLUMN_COMPATIBILITY,
+    COLUMN_COUNT
+} Column;
+
+static const char* column_names[COLUMN_COUNT] = {
+    "direction", "site", "name", "size", "release_date", "dependencies", "compatibility"
+};
+
+/* Позиция разбора: line_start нужен для номера столбца */
+typedef struct {
+    const char* p;
+    const char* end;
+    const char* line_start;
+    int line;
+} Cursor;
+
+typedef struct {
+    int line;
+    int column;
+} FieldPos;
+
+/* Значение поля: указывает прямо в данные файла или в буфер раскодированного текста */
+typedef struct {
+    const char* text;
+    int length;
+} Span;
+
+/* Первый байт из [p, end), равный a, b, c или d; end, если таких нет */
+static const char* scan_any(const char* p, const char* end, char a, char b, char c, char d)
+{
+    while (p < end && *p != a && *p != b && *p != c && *p != d) {
+        p++;
+    }
+    return p;
+}
+
+static FieldPos cursor_pos(const Cursor* cur)
+{
+    FieldPos pos;
+    
+    pos.line = cur->line;
+    pos.column = (int)(cur->p - cur->line_start) + 1;
+    return pos;
+}
+
+static int parse_error(FieldPos pos, const char* message)
+{
+    fprintf(stderr, "Ошибка в строке %d, столбец %d: %s\n", pos.line, pos.column, message);
+    return 0;
+}
+
+/* Перейти через перевод строки в позиции p */
+static void cursor_newline(Cursor* cur)
+{
+    cur->p++;
+    cur->line++;
+    cur->line_start = cur->p;
+}
+
+static int append_text(char* out, int* length, int size, const char* text, int count, FieldPos pos)
+{
+    char message[64];
+    
+    if (*length + count >= size) {
+        sprintf(message, "значение длиннее %d символов", size - 1);
+        return parse_error(pos, message);
+    }
+    
+    memcpy(out + *length, text, count);
+    *length += count;
+    return 1;
+}
+
+/* Скопировать значение в строку размера size; 0 - не помещается */
+static int copy_span(char* out, int size, Span value)
+{
+    if (value.length >= size) {
+        return 0;
+    }
+    
+    memcpy(out, value.text, value.length);
+    out[value.length] = '\0';
+    return 1;
+}
+
+/* Целое со знаком, допускается весь диапазон int */
+static int parse_int_span(Span value, int* result)
+{
+    const char* p = value.text;
+    const char* end = value.text + value.length;
+    long long limit = INT_MAX;
+    long long number = 0;
+    int negative = 0;
+    
+    if (p < end && *p == '-') {
+        negative = 1;
+        limit = -(long long)INT_MIN;
+        p++;
+    }
+    if (p == end) {
+        return 0;
+    }
+    
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') {
+            return 0;
+        }
+        number = number * 10 + (*p - '0');
+        if (number > limit) {
+            return 0;
+        }
+    }
+    
+    *result = (int)(negative ? -number : number);
+    return 1;
+}
+
+/* Число из count десятичных цифр; -1, если встретилась не цифра */
+static int parse_digits(const char* text, int count)
+{
+    int value = 0;
+    int i;
+    
+    for (i = 0; i < count; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return -1;
+        }
+        value = value * 10 + (text[i] - '0');
+    }
+    return value;
+}
+
+/* ГГГГ-ММ-ДД или ДД.ММ.ГГГГ; корректность самой даты проверяет validate_repository */
+static int parse_date_span(Span value, Date* date)
+{
+    const char* text = value.text;
+    
+    if (value.length != 10) {
+        return 0;
+    }
+    
+    if (text[4] == '-' && text[7] == '-') {
+        date->year = parse_digits(text, 4);
+        date->month = parse_digits(text + 5, 2);
+        date->day = parse_digits(text + 8, 2);
+    } else if (text[2] == '.' && text[5] == '.') {
+        date->day = parse_digits(text, 2);
+        date->month = parse_digits(text + 3, 2);
+        date->year = parse_digits(text + 6, 4);
+    } else {
+        return 0;
+    }
+    return date->year >= 0 && date->month >= 0 && date->day >= 0;
+}
+
+static int set_text(char* out, Span value, FieldPos pos)
+{
+    char message[64];
+    
+    if (!copy_span(out, MAX_LONG_STR, value)) {
+        sprintf(message, "значение длиннее %d символов", MAX_LONG_STR - 1);
+        return parse_error(pos, message);
+    }
+    return 1;
+}
+
+/* Записать значение столбца в запись; pos - начало поля для сообщения об ошибке */
+static int set_column(Repository* record, Column column, Span value, FieldPos pos)
+{
+    char name[MAX_STR];
+    
+    switch (column) {
+        case COLUMN_DIRECTION:
+            if (!copy_span(name, MAX_STR, value) || !string_to_direction(name, &record->direction)) {
+                return parse_error(pos, "некорректное направление");
+            }
+            return 1;
+        case COLUMN_SITE:
+            return set_text(record->site, value, pos);
+        case COLUMN_NAME:
+            return set_text(record->name, value, pos);
+        case COLUMN_SIZE:
+            if (!parse_int_span(value, &record->size)) {
+                return parse_error(pos, "размер должен быть целым числом");
+            }
+            return 1;
+        case COLUMN_RELEASE_DATE:
+            if (!parse_date_span(value, &record->release_date)) {
+                return parse_error(pos, "дата должна быть в формате ГГГГ-ММ-ДД");
+            }
+            return 1;
+        case COLUMN_DEPENDENCIES:
+            if (!parse_int_span(value, &record->dependencies)) {
+                return parse_error(pos, "зависимости должны быть целым числом");
+            }
+            return 1;
+        case COLUMN_COMPATIBILITY:
+            if (!copy_span(name, MAX_STR, value) ||
+                !string_to_compatibility(name, &record->compatibility)) {
+                return parse_error(pos, "некорректная совместимость");
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int column_by_name(Span name)
+{
+    int c;
+    
+    for (c = 0; c < COLUMN_COUNT; c++) {
+        if ((int)strlen(column_names[c]) == name.length &&
+            memcmp(name.text, column_names[c], name.length) == 0) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Выделить массив по числу строк файла - это верхняя граница числа записей,
+ * и массив не перевыделяется при разборе. Если памяти не хватило,
+ * list_slot наращивает массив по мере надобности.
+ */
+static void list_init(RecordList* list, const char* data, size_t size)
+{
+    const char* p = data;
+    const char* end = data + size;
+    long long lines = 1;
+    
+    while ((p = (const char*)memchr(p, '\n', end - p)) != NULL) {
+        lines++;
+        p++;
+    }
+    
+    list->count = 0;
+    list->capacity = lines < INT_MAX ? (int)lines : INT_MAX;
+    list->records = (Repository*)malloc((size_t)list->capacity * sizeof(Repository));
+    if (list->records == NULL) {
+        list->capacity = 0;
+    }
+}
+
+/* Ячейка для следующей записи; запись добавляется, когда вызывающий увеличит count */
+static Repository* list_slot(RecordList* list)
+{
+    Repository* temp;
+    int new_capacity;
+    
+    if (list->count >= list->capacity) {
+        new_capacity = list->capacity > 0 ? list->capacity * 2 : INITIAL_CAPACITY;
+        temp = (Repository*)realloc(list->records, new_capacity * sizeof(Repository));
+        if (temp == NULL) {
+            fprintf(stderr, "Ошибка выделения памяти при импорте\n");
+            return NULL;
+        }
+        list->records = temp;
+        list->capacity = new_capacity;
+    }
+    
+    return &list->records[list->count];
+}
+
+static int check_record(const Repository* record, FieldPos pos)
+{
+    const char* message = validate_repository(record);
+    
+    if (message != NULL) {
+        return parse_error(pos, message);
+    }
+    return 1;
+}
+
+/* Завершить разбор: при ошибке или пустом файле массив освобождается */
+static int list_finish(RecordList* list, int ok)
+{
+    if (ok && list->count == 0) {
+        fprintf(stderr, "Файл не содержит записей\n");
+        ok = 0;
+    }
+    
+    if (!ok) {
+        free(list->records);
+        list->records = NULL;
+        list->count = 0;
+        list->capacity = 0;
+    }
+    return ok;
+}
+
+/* Передать прочитанные записи в БД; массив переходит к db_replace_records */
+static int list_commit(RepositoryDB* db, RecordList* list)
+{
+    return db_replace_records(db, list->records, list->count, list->capacity, NULL, 0, NULL);
+}
+
+/*
+ * Прочитать поле CSV. Поле без кавычек и поле в кавычках без удвоенных
+ * кавычек и переводов строк возвращаются прямо в данных файла, остальные
+ * собираются в scratch. Возвращает разделитель после поля: ',' или '\n'
+ * (в том числе для конца файла), 0 - ошибка.
+ */
+static char csv_field(Cursor* cur, char* scratch, int size, Span* value, FieldPos* pos)
+{
+    const char* q;
+    int length = 0;
+    int quoted = 0;
+    
+    *pos = cursor_pos(cur);
+    
+    if (cur->p < cur->end && *cur->p == '"') {
+        quoted = 1;
+        cur->p++;
+        q = scan_any(cur->p, cur->end, '"', '\n', '"', '\n');
+        if (q < cur->end && *q == '"' && (q + 1 == cur->end || q[1] != '"')) {
+            value->text = cur->p;
+            value->length = (int)(q - cur->p);
+            cur->p = q + 1;
+        } else {
+            while (1) {
+                if (!append_text(scratch, &length, size, cur->p, (int)(q - cur->p), *pos)) {
+                    return 0;
+                }
+                cur->p = q;
+                if (q == cur->end) {
+                    parse_error(*pos, "незакрытая кавычка");
+                    return 0;
+                }
+                if (*q == '\n') {
+                    if (!append_text(scratch, &length, size, "\n", 1, *pos)) {
+                        return 0;
+                    }
+                    cursor_newline(cur);
+                } else if (q + 1 < cur->end && q[1] == '"') {
+                    if (!append_text(scratch, &length, size, "\"", 1, *pos)) {
+                        return 0;
+                    }
+                    cur->p = q + 2;
+                } else {
+                    cur->p = q + 1;
+                    break;
+                }
+                q = scan_any(cur->p, cur->end, '"', '\n', '"', '\n');
+            }
+            value->text = scratch;
+            value->length = length;
+        }
+    } else {
+        q = scan_any(cur->p, cur->end, ',', '\n', '"', '\r');
+        if (q < cur->end && *q == '"') {
+            cur->p = q;
+            parse_error(cursor_pos(cur), "кавычка внутри поля без кавычек");
+            return 0;
+        }
+        value->text = cur->p;
+        value->length = (int)(q - cur->p);
+        cur->p = q;
+    }
+    
+    if (cur->p == cur->end) {
+        return '\n';
+    }
+    if (*cur->p == ',') {
+        cur->p++;
+        return ',';
+    }
+    if (*cur->p == '\r' && cur->p + 1 < cur->end && cur->p[1] == '\n') {
+        cur->p++;
+    }
+    if (*cur->p == '\n') {
+        cursor_newline(cur);
+        return '\n';
+    }
+    
+    parse_error(cursor_pos(cur), quoted ? "после закрывающей кавычки ожидается ',' или конец строки"
+                                        : "символ '\\r' без '\\n' в поле без кавычек");
+    return 0;
+}
+
+static int csv_header(Cursor* cur, int* columns, int* column_count)
+{
+    char scratch[MAX_STR];
+    int seen[COLUMN_COUNT] = { 0 };
+    Span name;
+    FieldPos pos;
+    char separator = ',';
+    int c;
+    
+    *column_count = 0;
+    while (separator == ',') {
+        separator = csv_field(cur, scratch, MAX_STR, &name, &pos);
+        if (separator == 0) {
+            return 0;
+        }
+        c = column_by_name(name);
+        if (c < 0) {
+            return parse_error(pos, "неизвестный столбец");
+        }
+        if (seen[c]) {
+            return parse_error(pos, "столбец указан дважды");
+        }
+        if (*column_count == COLUMN_COUNT) {
+            return parse_error(pos, "слишком много столбцов");
+        }
+        seen[c] = 1;
+        columns[(*column_count)++] = c;
+    }
+    
+    for (c = 0; c < COLUMN_COUNT; c++) {
+        if (!seen[c]) {
+            fprintf(stderr, "Ошибка в строке 1: нет столбца \"%s\"\n", column_names[c]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int csv_records(Cursor* cur, const int* columns, int column_count, RecordList* list)
+{
+    char scratch[MAX_LONG_STR];
+    Repository* record;
+    Span value;
+    FieldPos record_pos;
+    FieldPos pos;
+    char separator;
+    int c;
+    
+    while (cur->p < cur->end) {
+        /* Пустые строки между записями пропускаются */
+        if (*cur->p == '\n' || (*cur->p == '\r' && cur->p + 1 < cur->end && cur->p[1] == '\n')) {
+            cur->p += *cur->p == '\r';
+            cursor_newline(cur);
+            continue;
+        }
+        
+        record = list_slot(list);
+        if (record == NULL) {
+            return 0;
+        }
+        
+        record_pos = cursor_pos(cur);
+        for (c = 0; c < column_count; c++) {
+            separator = csv_field(cur, scratch, MAX_LONG_STR, &value, &pos);
+            if (separator == 0 || !set_column(record, (Column)columns[c], value, pos)) {
+                return 0;
+            }
+            if (separator == '\n' && c < column_count - 1) {
+                return parse_error(pos, "не хватает полей в записи");
+            }
+            if (separator == ',' && c == column_count - 1) {
+                return parse_error(cursor_pos(cur), "лишнее поле в записи");
+            }
+        }
+        
+        if (!check_record(record, record_pos)) {
+            return 0;
+        }
+        list->count++;
+    }
+    
+    return 1;
+}
+
+/* Прочитать CSV в list; при ошибке list пуст */
+int read_csv_records(const char* filename, RecordList* list)
+{
+    Cursor cur;
+    char* data;
+    size_t size;
+    int columns[COLUMN_COUNT];
+    int column_count;
+    int ok;
+    
+    list->records = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    
+    data = (char*)read_whole_file(filename, &size);
+    if (data == NULL) {
+        return 0;
+    }
+    
+    list_init(list, data, size);
+    cur.p = data;
+    cur.end = data + size;
+    cur.line_start = data;
+    cur.line = 1;
+    
+    ok = csv_header(&cur, columns, &column_count) &&
+         csv_records(&cur, columns, column_count, list);
+    
+    free(data);
+    return list_finish(list, ok);
+}
+
+int db_import_csv(RepositoryDB* db, const char* filename)
+{
+    RecordList list;
+    
+    if (db == NULL || filename == NULL) {
+        fprintf(stderr, "Ошибка: некорректные параметры в db_import_csv\n");
+        return 0;
+    }
+    
+    return read_csv_records(filename, &list) && list_commit(db, &list);
+}
+
+static void json_skip_space(Cursor* cur)
+{
+    while (cur->p < cur->end && (*cur->p == ' ' || *cur->p == '\t' || *cur->p == '\r')) {
+        cur->p++;
+    }
+}
+
+static int json_expect(Cursor* cur, char expected, const char* message)
+{
+    json_skip_space(cur);
+    if (cur->p >= cur->end || *cur->p != expected) {
+        return parse_error(cursor_pos(cur), message);
+    }
+    cur->p++;
+    return 1;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Строка JSON; cur->p стоит на открывающей кавычке. Строка без
+ * escape-последовательностей возвращается прямо в данных файла,
+ * остальные раскодируются в scratch.
+ */
+static int json_string(Cursor* cur, char* scratch, int size, Span* value, FieldPos* pos)
+{
+    const char* q;
+    char decoded;
+    int length = 0;
+    int code;
+    int i;
+    
+    *pos = cursor_pos(cur);
+    if (cur->p >= cur->end || *cur->p != '"') {
+        return parse_error(*pos, "ожидается строка");
+    }
+    cur->p++;
+    
+    q = scan_any(cur->p, cur->end, '"', '\\', '\n', '\n');
+    if (q < cur->end && *q == '"') {
+        value->text = cur->p;
+        value->length = (int)(q - cur->p);
+        cur->p = q + 1;
+        return 1;
+    }
+    
+    while (1) {
+        if (!append_text(scratch, &length, size, cur->p, (int)(q - cur->p), *pos)) {
+            return 0;
+        }
+        cur->p = q;
+        if (q == cur->end || *q == '\n') {
+            return parse_error(*pos, "незакрытая строка");
+        }
+        if (*q == '"') {
+            cur->p++;
+            break;
+        }
+        
+        if (q + 1 >= cur->end) {
+            return parse_error(*pos, "незакрытая строка");
+        }
+        switch (q[1]) {
+            case '"': decoded = '"'; break;
+            case '\\': decoded = '\\'; break;
+            case '/': decoded = '/'; break;
+            case 'b': decoded = '\b'; break;
+            case 'f': decoded = '\f'; break;
+            case 'n': decoded = '\n'; break;
+            case 'r': decoded = '\r'; break;
+            case 't': decoded = '\t'; break;
+            case 'u':
+                code = 0;
+                for (i = 2; i < 6; i++) {
+                    if (q + i >= cur->end || hex_value(q[i]) < 0) {
+                        return parse_error(cursor_pos(cur), "некорректная последовательность \\u");
+                    }
+                    code = code * 16 + hex_value(q[i]);
+                }
+                if (code >= 0x80) {
+                    return parse_error(cursor_pos(cur), "поддерживаются только символы \\u0000-\\u007f");
+                }
+                decoded = (char)code;
+                cur->p += 4;
+                break;
+            default:
+                return parse_error(cursor_pos(cur), "некорректная escape-последовательность");
+        }
+        if (!append_text(scratch, &length, size, &decoded, 1, *pos)) {
+            return 0;
+        }
+        cur->p += 2;
+        q = scan_any(cur->p, cur->end, '"', '\\', '\n', '\n');
+    }
+    
+    value->text = scratch;
+    value->length = length;
+    return 1;
+}
+
+/* Число или литерал до ближайшего разделителя, прямо в данных файла */
+static int json_scalar(Cursor* cur, Span* value, FieldPos* pos)
+{
+    const char* q;
+    
+    *pos = cursor_pos(cur);
+    q = scan_any(cur->p, cur->end, ',', '}', '\n', ' ');
+    while (q > cur->p && (q[-1] == '\r' || q[-1] == '\t')) {
+        q--;
+    }
+    if (q == cur->p) {
+        return parse_error(*pos, "ожидается значение");
+    }
+    
+    value->text = cur->p;
+    value->length = (int)(q - cur->p);
+    cur->p = q;
+    return 1;
+}
+
+static int json_object(Cursor* cur, Repository* record)
+{
+    char key_scratch[MAX_STR];
+    char scratch[MAX_LONG_STR];
+    int seen[COLUMN_COUNT] = { 0 };
+    Span key;
+    Span value;
+    FieldPos object_pos;
+    FieldPos pos;
+    char message[64];
+    int column;
+    int c;
+    
+    object_pos = cursor_pos(cur);
+    if (!json_expect(cur, '{', "ожидается объект '{'")) {
+        return 0;
+    }
+    
+    json_skip_space(cur);
+    if (cur->p < cur->end && *cur->p == '}') {
+        cur->p++;
+    } else {
+        while (1) {
+            json_skip_space(cur);
+            if (!json_string(cur, key_scratch, MAX_STR, &key, &pos) ||
+                !json_expect(cur, ':', "ожидается ':'")) {
+                return 0;
+            }
+            json_skip_space(cur);
+            
+            column = column_by_name(key);
+            if (column >= 0 && seen[column]) {
+                return parse_error(pos, "ключ указан дважды");
+            }
+            
+            if (cur->p < cur->end && *cur->p == '"') {
+                if (!json_string(cur, scratch, MAX_LONG_STR, &value, &pos)) {
+                    return 0;
+                }
+                if (column == COLUMN_SIZE || column == COLUMN_DEPENDENCIES) {
+                    return parse_error(pos, "ожидается целое число");
+                }
+            } else if (cur->p < cur->end && (*cur->p == '{' || *cur->p == '[')) {
+                return parse_error(cursor_pos(cur), "вложенные объекты и массивы не поддерживаются");
+            } else {
+                if (!json_scalar(cur, &value, &pos)) {
+                    return 0;
+                }
+                if (column >= 0 && column != COLUMN_SIZE && column != COLUMN_DEPENDENCIES) {
+                    return parse_error(pos, "ожидается строка");
+                }
+            }
+            
+            if (column >= 0) {
+                if (!set_column(record, (Column)column, value, pos)) {
+                    return 0;
+                }
+                seen[column] = 1;
+            }
+            
+            json_skip_space(cur);
+            if (cur->p < cur->end && *cur->p == ',') {
+                cur->p++;
+                continue;
+            }
+            if (!json_expect(cur, '}', "ожидается ',' или '}'")) {
+                return 0;
+            }
+            break;
+        }
+    }
+    
+    for (c = 0; c < COLUMN_COUNT; c++) {
+        if (!seen[c]) {
+            sprintf(message, "нет поля \"%s\"", column_names[c]);
+            return parse_error(object_pos, message);
+        }
+    }
+    
+    json_skip_space(cur);
+    if (cur->p < cur->end && *cur->p != '\n') {
+        return parse_error(cursor_pos(cur), "лишние данные после объекта");
+    }
+    if (cur->p < cur->end) {
+        cursor_newline(cur);
+    }
+    
+    return check_record(record, object_pos);
+}
+
+/* Прочитать JSON Lines в list; при ошибке list пуст */
+int read_jsonl_records(const char* filename, RecordList* list)
+{
+    Repository* record;
+    Cursor cur;
+    char* data;
+    size_t size;
+    int ok = 1;
+    
+    list->records = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    
+    data = (char*)read_whole_file(filename, &size);
+    if (data == NULL) {
+        return 0;
+    }
+    
+    list_init(list, data, size);
+    cur.p = data;
+    cur.end = data + size;
+    cur.line_start = data;
+    cur.line = 1;
+    
+    while (ok) {
+        json_skip_space(&cur);
+        if (cur.p >= cur.end) {
+            break;
+        }
+        if (*cur.p == '\n') {
+            cursor_newline(&cur);
+            continue;
+        }
+        record = list_slot(list);
+        ok = record != NULL && json_object(&cur, record);
+        if (ok) {
+            list->count++;
+        }
+    }
+    
+    free(data);
+    return list_finish(list, ok);
+}
+
+int db_import_jsonl(RepositoryDB* db, const char* filename)
+{
+    RecordList list;
+    
+    if (db == NULL || filename == NULL) {
+        fprintf(stderr, "Ошибка: некорректные параметры в db_import_jsonl\n");
+        return 0;
+    }
+    
+    return read_jsonl_records(filename, &list) && list_commit(db, &list);
+}
+
+static int has_extension(const char* filename, const char* extension)
+{
+    size_t length = strlen(filename);
+    size_t ext_length = strlen(extension);
+    
+    return length > ext_length && strcmp(filename + length - ext_length, extension) == 0;
+}
+
+int has_csv_extension(const char* filename)
+{
+    return has_extension(filename, CSV_EXTENSION);
+}
+
+int has_jsonl_extension(const char* filename)
+{
+    return has_extension(filename, JSONL_EXTENSION);
+}
+
+static int csv_put(FILE* file, const char* value)
+{
+    const char* p;
+    
+    if (strpbrk(value, ",\"\r\n") == NULL) {
+        return fputs(value, file) >= 0;
+    }
+    
+    if (fputc('"', file) == EOF) {
+        return 0;
+    }
+    for (p = value; *p != '\0'; p++) {
+        if ((*p == '"' && fputc('"', file) == EOF) || fputc(*p, file) == EOF) {
+            return 0;
+        }
+    }
+    return fputc('"', file) != EOF;
+}
+
+static int json_put(FILE* file, const char* value)
+{
+    const unsigned char* p;
+    
+    if (fputc('"', file) == EOF) {
+        return 0;
+    }
+    for (p = (const unsigned char*)value; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\') {
+            if (fputc('\\', file) == EOF || fputc(*p, file) == EOF) {
+                return 0;
+            }
+        } else if (*p == '\n' || *p == '\t') {
+            if (fputs(*p == '\n' ? "\\n" : "\\t", file) < 0) {
+                return 0;
+            }
+        } else if (*p < 0x20) {
+            if (fprintf(file, "\\u%04x", *p) < 0) {
+                return 0;
+            }
+        } else if (fputc(*p, file) == EOF) {
+            return 0;
+        }
+    }
+    return fputc('"', file) != EOF;
+}
+
+static int write_csv_record(FILE* file, const Repository* record)
+{
+    return fprintf(file, "%s,", direction_to_string(record->direction)) >= 0 &&
+           csv_put(file, record->site) && fputc(',', file) != EOF &&
+           csv_put(file, record->name) &&
+           fprintf(file, ",%d,%04d-%02d-%02d,%d,%s\n", record->size,
+               record->release_date.year, record->release_date.month, record->release_date.day,
+               record->dependencies, compatibility_to_string(record->compatibility)) >= 0;
+}
+
+static int write_jsonl_record(FILE* file, const Repository* record)
+{
+    return fprintf(file, "{\"direction\":\"%s\",\"site\":", direction_to_string(record->direction)) >= 0 &&
+           json_put(file, record->site) && fputs(",\"name\":", file) >= 0 &&
+           json_put(file, record->name) &&
+           fprintf(file, ",\"size\":%d,\"release_date\":\"%04d-%02d-%02d\",\"dependencies\":%d,"
+               "\"compatibility\":\"%s\"}\n", record->size,
+               record->release_date.year, record->release_date.month, record->release_date.day,
+               record->dependencies, compatibility_to_string(record->compatibility)) >= 0;
+}
+
+static int write_records(DBSnapshot* snapshot, FILE* file, SaveProgress* progress,
+                         int (*write_record)(FILE*, const Repository*))
+{
+    RecordChunk* chunk;
+    int c, i;
+    
+    for (c = 0; c < snapshot->chunk_count; c++) {
+        chunk = snapshot->chunks[c];
+        for (i = 0; i < chunk->count; i++) {
+            if (!chunk->dead[i] && !write_record(file, &chunk->records[i])) {
+                fprintf(stderr, "Ошибка записи в файл\n");
+                return 0;
+            }
+        }
+        
+        if (progress != NULL) {
+            progress->written += chunk->count;
+        }
+    }
+    
+    return 1;
+}
+
+int snapshot_write_csv(DBSnapshot* snapshot, FILE* file, SaveProgress* progress)
+{
+    int c;
+    
+    for (c = 0; c < COLUMN_COUNT; c++) {
+        if (fprintf(file, c == 0 ? "%s" : ",%s", column_names[c]) < 0) {
+            return 0;
+        }
+    }
+    if (fputc('\n', file) == EOF) {
+        return 0;
+    }
+    
+    return write_records(snapshot, file, progress, write_csv_record);
+}
+
+int snapshot_write_jsonl(DBSnapshot* snapshot, FILE* file, SaveProgress* progress)
+{
+    return write_records(snapshot, file, progress, write_jsonl_record);
+}
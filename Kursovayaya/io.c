@@ -1,7 +1,7 @@
 /**
  * @file io.c
- * @brief    -  -
- * @author   
+ * @brief База данных репозитория - функции ввода-вывода
+ * @author Костопраев Дмитрий Евгеньевич
  */
 
 #include <stdio.h>
@@ -10,10 +10,14 @@
 
 int show_menu()
 {
-    printf("\n---  ---\n");
-    printf("1.   \n2.  \n3.   \n");
-    printf("4.  \n5. \n6.  \n7. \n8. \n");
-    printf(" (1-8): ");
+    printf("\n--- МЕНЮ ---\n");
+    printf("1. Загрузить из файла\n2. Просмотреть записи\n3. Поиск по направлению\n");
+    printf("4. Комбинированный поиск\n5. Сортировка\n6. Добавить запись\n7. Сохранить\n");
+    printf("8. Поиск по диапазону\n9. Статистика\n10. Удалить запись\n11. Изменить запись\n");
+    printf("12. Состояние сохранения\n13. K лучших по полю\n14. Открыть файл без загрузки\n");
+    printf("15. Записи открытого файла\n16. Поиск по направлению в открытом файле\n");
+    printf("17. Объединить файлы\n18. Приближённая статистика\n19. Выход\n");
+    printf("Выбор (1-19): ");
     
     return read_int();
 }
@@ -27,7 +31,7 @@ int read_int()
     
     while (result != 1) {
         while (getchar() != '\n');
-        fprintf(stderr, "! : ");
+        fprintf(stderr, "Ошибка! Число: ");
         result = scanf("%d", &value);
     }
     
@@ -39,7 +43,7 @@ int read_int()
 int read_string(char* buffer, int size)
 {
     if (buffer == NULL || size <= 0) {
-        fprintf(stderr, ":    read_string\n");
+        fprintf(stderr, "Ошибка: некорректные параметры в read_string\n");
         return 0;
     }
     
@@ -57,19 +61,19 @@ Date read_date()
     int valid = 0;
     
     while (!valid) {
-        printf(" (1-31): ");
+        printf("День (1-31): ");
         date.day = read_int();
         
-        printf(" (1-12): ");
+        printf("Месяц (1-12): ");
         date.month = read_int();
         
-        printf(" (1900-2100): ");
+        printf("Год (1900-2100): ");
         date.year = read_int();
         
         if (validate_date(date)) {
             valid = 1;
         } else {
-            fprintf(stderr, ":  \n");
+            fprintf(stderr, "Ошибка: некорректная дата\n");
         }
     }
     
@@ -81,16 +85,16 @@ Direction read_direction()
     int choice;
     int i;
     
-    printf("\n :\n");
+    printf("\nВыберите направление:\n");
     for (i = 0; i < DIRECTION_COUNT; i++) {
         printf("%d. %s\n", i + 1, dir_names[i]);
     }
-    printf(" (1-%d): ", DIRECTION_COUNT);
+    printf("Выбор (1-%d): ", DIRECTION_COUNT);
     
     choice = read_int();
     
     while (choice < 1 || choice > DIRECTION_COUNT) {
-        fprintf(stderr, ": 1-%d: ", DIRECTION_COUNT);
+        fprintf(stderr, "Ошибка: 1-%d: ", DIRECTION_COUNT);
         choice = read_int();
     }
     
@@ -102,64 +106,83 @@ Compatibility read_compatibility()
     int choice;
     int i;
     
-    printf("\n :\n");
+    printf("\nВыберите совместимость:\n");
     for (i = 0; i < COMPAT_COUNT; i++) {
         printf("%d. %s\n", i + 1, compat_names[i]);
     }
-    printf(" (1-%d): ", COMPAT_COUNT);
+    printf("Выбор (1-%d): ", COMPAT_COUNT);
     
     choice = read_int();
     
     while (choice < 1 || choice > COMPAT_COUNT) {
-        fprintf(stderr, ": 1-%d: ", COMPAT_COUNT);
+        fprintf(stderr, "Ошибка: 1-%d: ", COMPAT_COUNT);
         choice = read_int();
     }
     
     return (Compatibility)(choice - 1);
 }
 
+NumericField read_numeric_field()
+{
+    int choice;
+    int i;
+    
+    printf("\nВыберите поле:\n");
+    for (i = 0; i < FIELD_COUNT; i++) {
+        printf("%d. %s\n", i + 1, field_names[i]);
+    }
+    printf("Выбор (1-%d): ", FIELD_COUNT);
+    
+    choice = read_int();
+    
+    while (choice < 1 || choice > FIELD_COUNT) {
+        fprintf(stderr, "Ошибка: 1-%d: ", FIELD_COUNT);
+        choice = read_int();
+    }
+    
+    return (NumericField)(choice - 1);
+}
+
 int read_repository_record(Repository* record)
 {
     int value;
     
     if (record == NULL) {
-        fprintf(stderr, ":    read_repository_record\n");
+        fprintf(stderr, "Ошибка: некорректный параметр в read_repository_record\n");
         return 0;
     }
     
-    printf("\n---   ---\n");
-    
     record->direction = read_direction();
     
-    printf("\n: ");
+    printf("\nСайт: ");
     if (!read_string(record->site, MAX_LONG_STR)) {
-        fprintf(stderr, "  \n");
+        fprintf(stderr, "Ошибка чтения сайта\n");
         return 0;
     }
     
-    printf(": ");
+    printf("Название: ");
     if (!read_string(record->name, MAX_LONG_STR)) {
-        fprintf(stderr, "  \n");
+        fprintf(stderr, "Ошибка чтения названия\n");
         return 0;
     }
     
-    printf(" (, > 0): ");
+    printf("Размер (Кб, > 0): ");
     value = read_int();
     while (value <= 0) {
-        fprintf(stderr, ": > 0\n");
-        printf(": ");
+        fprintf(stderr, "Ошибка: > 0\n");
+        printf("Размер: ");
         value = read_int();
     }
     record->size = value;
     
-    printf("\n :\n");
+    printf("\nДата релиза:\n");
     record->release_date = read_date();
     
-    printf("\n (>= 0): ");
+    printf("\nЗависимости (>= 0): ");
     value = read_int();
     while (value < 0) {
-        fprintf(stderr, ": >= 0\n");
-        printf(": ");
+        fprintf(stderr, "Ошибка: >= 0\n");
+        printf("Зависимости: ");
         value = read_int();
     }
     record->dependencies = value;
@@ -168,3 +191,25 @@ int read_repository_record(Repository* record)
     
     return 1;
 }
+
+/* Выбор значения перечисления для фильтра: -1, если фильтр не нужен */
+int read_filter(const char* title, const char* names[], int count)
+{
+    int choice;
+    int i;
+    
+    printf("\n%s:\n0. Любое\n", title);
+    for (i = 0; i < count; i++) {
+        printf("%d. %s\n", i + 1, names[i]);
+    }
+    printf("Выбор (0-%d): ", count);
+    
+    choice = read_int();
+    
+    while (choice < 0 || choice > count) {
+        fprintf(stderr, "Ошибка: 0-%d: ", count);
+        choice = read_int();
+    }
+    
+    return choice - 1;
+}
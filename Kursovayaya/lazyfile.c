@@ -0,0 +1,468 @@
+/**
+ * @file lazyfile.c
+ * @brief База данных репозитория - открытие файла без загрузки
+ * @author Костопраев Дмитрий Евгеньевич
+ *
+ * Один проход по файлу считает непустые строки и запоминает смещение
+ * каждой LAZY_CHUNK_SIZE-й записи. Пустые строки и пробелы в начале строки
+ * пропускаются так же, как при загрузке (read_text_record). Индекс
+ * сохраняется рядом с файлом (<имя>.idx) вместе с размером, временем
+ * изменения и отпечатком содержимого файла и при следующем открытии
+ * читается вместо прохода. Записи разбираются кусками по запросу;
+ * последние LAZY_CACHE_CHUNKS кусков хранятся в кэше.
+ *
+ * Каждое поле записи должно занимать свою строку, как его пишет db_save_to_file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "repository.h"
+
+#define LAZY_INDEX_MAGIC "RPI2"
+#define LAZY_LINES_PER_RECORD 7
+#define LAZY_SCAN_BUFFER (1 << 20)
+#define LAZY_SAMPLE_SIZE 4096
+#define LAZY_SAMPLE_CHUNKS 64
+
+/*
+ * fingerprint - хеш начала и конца файла и начал до LAZY_SAMPLE_CHUNKS кусков:
+ * время изменения хранится с точностью до секунды, и перезапись файла
+ * того же размера в ту же секунду отличается только содержимым.
+ */
+typedef struct {
+    long long size;
+    long long mtime;
+    unsigned long long fingerprint;
+    int count;
+    int chunk_count;
+} LazyIndexHeader;
+
+int lazy_init(LazyFile* lazy)
+{
+    int i;
+    
+    if (lazy == NULL) {
+        return 0;
+    }
+    
+    lazy->file = NULL;
+    lazy->filename[0] = '\0';
+    lazy->count = 0;
+    lazy->chunk_count = 0;
+    lazy->offsets = NULL;
+    for (i = 0; i < LAZY_CACHE_CHUNKS; i++) {
+        lazy->cache[i].chunk = -1;
+        lazy->cache[i].records = NULL;
+    }
+    lazy->tick = 0;
+    lazy->hits = 0;
+    lazy->misses = 0;
+    return 1;
+}
+
+int lazy_close(LazyFile* lazy)
+{
+    int i;
+    
+    if (lazy == NULL) {
+        return 0;
+    }
+    
+    if (lazy->file != NULL) {
+        fclose(lazy->file);
+    }
+    free(lazy->offsets);
+    for (i = 0; i < LAZY_CACHE_CHUNKS; i++) {
+        free(lazy->cache[i].records);
+    }
+    
+    return lazy_init(lazy);
+}
+
+static int offsets_append(LazyFile* lazy, int* capacity, long long offset)
+{
+    long long* temp;
+    
+    if (lazy->chunk_count >= *capacity) {
+        *capacity = *capacity > 0 ? *capacity * 2 : INITIAL_CAPACITY;
+        temp = (long long*)realloc(lazy->offsets, *capacity * sizeof(long long));
+        if (temp == NULL) {
+            fprintf(stderr, "Ошибка выделения памяти для индекса\n");
+            return 0;
+        }
+        lazy->offsets = temp;
+    }
+    
+    lazy->offsets[lazy->chunk_count++] = offset;
+    return 1;
+}
+
+static int is_blank(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/* Учесть непустую строку, начинающуюся с line_start; запись закончена на седьмой */
+static int count_line(LazyFile* lazy, int* capacity, int* lines, long long* record_start,
+                      long long line_start)
+{
+    if (*lines == 0) {
+        *record_start = line_start;
+    }
+    if (++*lines < LAZY_LINES_PER_RECORD) {
+        return 1;
+    }
+    
+    *lines = 0;
+    if (lazy->count % LAZY_CHUNK_SIZE == 0 && !offsets_append(lazy, capacity, *record_start)) {
+        return 0;
+    }
+    lazy->count++;
+    return 1;
+}
+
+/*
+ * Проход по файлу. line_start - смещение первого непробельного символа
+ * текущей строки или -1, пока такого нет: строка может продолжаться
+ * в следующем прочитанном блоке.
+ */
+static int build_index(LazyFile* lazy, const char* filename)
+{
+    FILE* file;
+    unsigned char* buffer;
+    const unsigned char* p;
+    const unsigned char* end;
+    const unsigned char* newline;
+    long long base = 0;
+    long long record_start = 0;
+    long long line_start = -1;
+    int lines = 0;
+    int capacity = 0;
+    int ok = 1;
+    size_t length;
+    
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        perror("Ошибка открытия файла");
+        return 0;
+    }
+    
+    buffer = (unsigned char*)malloc(LAZY_SCAN_BUFFER);
+    if (buffer == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для индекса\n");
+        fclose(file);
+        return 0;
+    }
+    
+    while (ok && (length = fread(buffer, 1, LAZY_SCAN_BUFFER, file)) > 0) {
+        p = buffer;
+        end = buffer + length;
+        
+        while (ok && p < end) {
+            if (line_start < 0) {
+                while (p < end && is_blank(*p)) {
+                    p++;
+                }
+                if (p == end) {
+                    break;
+                }
+                if (*p == '\n') {
+                    p++;
+                    continue;
+                }
+                line_start = base + (p - buffer);
+            }
+            
+            newline = (const unsigned char*)memchr(p, '\n', end - p);
+            if (newline == NULL) {
+                break;
+            }
+            ok = count_line(lazy, &capacity, &lines, &record_start, line_start);
+            line_start = -1;
+            p = newline + 1;
+        }
+        
+        base += (long long)length;
+    }
+    
+    /* Последняя строка может не заканчиваться переводом строки */
+    if (ok && line_start >= 0) {
+        ok = count_line(lazy, &capacity, &lines, &record_start, line_start);
+    }
+    
+    free(buffer);
+    fclose(file);
+    return ok;
+}
+
+/* Добавить к хешу до LAZY_SAMPLE_SIZE байт файла с позиции position */
+static int hash_sample(FILE* file, long long position, unsigned long long* hash)
+{
+    unsigned char sample[LAZY_SAMPLE_SIZE];
+    size_t length;
+    size_t i;
+    
+    if (!platform_seek(file, position)) {
+        return 0;
+    }
+    
+    length = fread(sample, 1, sizeof(sample), file);
+    for (i = 0; i < length; i++) {
+        *hash = (*hash ^ sample[i]) * 1099511628211ull;
+    }
+    return 1;
+}
+
+static unsigned long long index_fingerprint(const LazyFile* lazy, const char* filename, long long size)
+{
+    FILE* file;
+    unsigned long long hash = 14695981039346656037ull;
+    int step = lazy->chunk_count / LAZY_SAMPLE_CHUNKS + 1;
+    int ok;
+    int c;
+    
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    
+    ok = hash_sample(file, 0, &hash) &&
+         hash_sample(file, size > LAZY_SAMPLE_SIZE ? size - LAZY_SAMPLE_SIZE : 0, &hash);
+    for (c = 0; ok && c < lazy->chunk_count; c += step) {
+        ok = hash_sample(file, lazy->offsets[c], &hash);
+    }
+    
+    fclose(file);
+    return ok ? hash : 0;
+}
+
+static void index_name(const char* filename, char* name)
+{
+    sprintf(name, "%s%s", filename, LAZY_INDEX_EXTENSION);
+}
+
+/* Прочитать сохранённый индекс, если он построен для этой же версии файла */
+static int load_index(LazyFile* lazy, const char* filename, long long size, long long mtime)
+{
+    char name[MAX_FILENAME + sizeof(LAZY_INDEX_EXTENSION)];
+    char magic[4];
+    LazyIndexHeader header;
+    FILE* file;
+    int ok = 0;
+    
+    index_name(filename, name);
+    file = fopen(name, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    
+    if (fread(magic, 1, 4, file) == 4 && memcmp(magic, LAZY_INDEX_MAGIC, 4) == 0 &&
+        fread(&header, sizeof(header), 1, file) == 1 &&
+        header.size == size && header.mtime == mtime && header.count >= 0 &&
+        header.chunk_count == (header.count + LAZY_CHUNK_SIZE - 1) / LAZY_CHUNK_SIZE) {
+        lazy->offsets = (long long*)malloc((header.chunk_count > 0 ? header.chunk_count : 1) *
+                                           sizeof(long long));
+        if (lazy->offsets != NULL &&
+            fread(lazy->offsets, sizeof(long long), header.chunk_count, file) ==
+                (size_t)header.chunk_count) {
+            lazy->count = header.count;
+            lazy->chunk_count = header.chunk_count;
+            ok = index_fingerprint(lazy, filename, size) == header.fingerprint;
+        }
+        if (!ok) {
+            lazy->count = 0;
+            lazy->chunk_count = 0;
+            free(lazy->offsets);
+            lazy->offsets = NULL;
+        }
+    }
+    
+    fclose(file);
+    return ok;
+}
+
+/* Сохранить индекс атомарно; неудача не мешает работе с файлом */
+static int save_index(const LazyFile* lazy, const char* filename, long long size, long long mtime)
+{
+    char name[MAX_FILENAME + sizeof(LAZY_INDEX_EXTENSION)];
+    char temp_name[MAX_FILENAME + sizeof(LAZY_INDEX_EXTENSION) + 4];
+    LazyIndexHeader header;
+    FILE* file;
+    int ok;
+    
+    index_name(filename, name);
+    sprintf(temp_name, "%s.tmp", name);
+    
+    file = fopen(temp_name, "wb");
+    if (file == NULL) {
+        return 0;
+    }
+    
+    memset(&header, 0, sizeof(header));
+    header.size = size;
+    header.mtime = mtime;
+    header.fingerprint = index_fingerprint(lazy, filename, size);
+    header.count = lazy->count;
+    header.chunk_count = lazy->chunk_count;
+    
+    ok = fwrite(LAZY_INDEX_MAGIC, 1, 4, file) == 4 &&
+         fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(lazy->offsets, sizeof(long long), lazy->chunk_count, file) ==
+             (size_t)lazy->chunk_count &&
+         platform_file_sync(file);
+    
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok || !platform_replace_file(temp_name, name)) {
+        remove(temp_name);
+        return 0;
+    }
+    return 1;
+}
+
+/* Открыть файл данных: индекс читается с диска или строится одним проходом */
+int lazy_open(LazyFile* lazy, const char* filename)
+{
+    long long size;
+    long long mtime;
+    
+    if (lazy == NULL || filename == NULL || strlen(filename) >= MAX_FILENAME) {
+        fprintf(stderr, "Ошибка: некорректные параметры в lazy_open\n");
+        return 0;
+    }
+    
+    lazy_close(lazy);
+    
+    if (!platform_file_info(filename, &size, &mtime)) {
+        perror("Ошибка открытия файла");
+        return 0;
+    }
+    
+    if (!load_index(lazy, filename, size, mtime)) {
+        if (!build_index(lazy, filename)) {
+            lazy_close(lazy);
+            return 0;
+        }
+        if (!save_index(lazy, filename, size, mtime)) {
+            fprintf(stderr, "Не удалось сохранить индекс '%s%s'\n", filename, LAZY_INDEX_EXTENSION);
+        }
+    }
+    
+    if (lazy->count == 0) {
+        fprintf(stderr, "Файл пуст или имеет неверный формат\n");
+        lazy_close(lazy);
+        return 0;
+    }
+    
+    /* Двоичный режим: смещения индекса посчитаны в байтах файла, с CRLF */
+    lazy->file = fopen(filename, "rb");
+    if (lazy->file == NULL) {
+        perror("Ошибка открытия файла");
+        lazy_close(lazy);
+        return 0;
+    }
+    
+    strcpy(lazy->filename, filename);
+    return 1;
+}
+
+/* Разобрать кусок chunk в слот кэша */
+static int parse_chunk(LazyFile* lazy, LazyChunk* slot, int chunk)
+{
+    int first = chunk * LAZY_CHUNK_SIZE;
+    int count = lazy->count - first < LAZY_CHUNK_SIZE ? lazy->count - first : LAZY_CHUNK_SIZE;
+    int i;
+    
+    if (slot->records == NULL) {
+        slot->records = (Repository*)malloc(LAZY_CHUNK_SIZE * sizeof(Repository));
+        if (slot->records == NULL) {
+            fprintf(stderr, "Ошибка выделения памяти для кэша записей\n");
+            return 0;
+        }
+    }
+    
+    slot->chunk = -1;
+    if (!platform_seek(lazy->file, lazy->offsets[chunk])) {
+        perror("Ошибка позиционирования в файле");
+        return 0;
+    }
+    
+    for (i = 0; i < count; i++) {
+        if (read_text_record(lazy->file, &slot->records[i], first + i + 1) != 1) {
+            fprintf(stderr, "Ошибка разбора записи %d, файл изменился или имеет неверный формат\n",
+                first + i + 1);
+            return 0;
+        }
+    }
+    
+    slot->chunk = chunk;
+    slot->count = count;
+    return 1;
+}
+
+/*
+ * Запись по номеру. Указатель действителен до следующего вызова lazy_get
+ * или lazy_search_by_direction: кусок может быть вытеснен из кэша.
+ */
+const Repository* lazy_get(LazyFile* lazy, int index)
+{
+    LazyChunk* victim;
+    int chunk;
+    int i;
+    
+    if (lazy == NULL || lazy->file == NULL || index < 0 || index >= lazy->count) {
+        return NULL;
+    }
+    
+    chunk = index / LAZY_CHUNK_SIZE;
+    victim = &lazy->cache[0];
+    
+    for (i = 0; i < LAZY_CACHE_CHUNKS; i++) {
+        if (lazy->cache[i].chunk == chunk) {
+            lazy->cache[i].last_used = ++lazy->tick;
+            lazy->hits++;
+            return &lazy->cache[i].records[index % LAZY_CHUNK_SIZE];
+        }
+        if (lazy->cache[i].chunk < 0) {
+            if (victim->chunk >= 0) {
+                victim = &lazy->cache[i];
+            }
+        } else if (victim->chunk >= 0 && lazy->cache[i].last_used < victim->last_used) {
+            victim = &lazy->cache[i];
+        }
+    }
+    
+    lazy->misses++;
+    if (!parse_chunk(lazy, victim, chunk)) {
+        return NULL;
+    }
+    
+    victim->last_used = ++lazy->tick;
+    return &victim->records[index % LAZY_CHUNK_SIZE];
+}
+
+SearchResult lazy_search_by_direction(LazyFile* lazy, Direction direction)
+{
+    SearchResult result = { NULL, 0, NULL };
+    const Repository* record;
+    int capacity = 0;
+    int i;
+    
+    if (lazy == NULL || lazy->file == NULL) {
+        return result;
+    }
+    
+    for (i = 0; i < lazy->count; i++) {
+        record = lazy_get(lazy, i);
+        if (record == NULL) {
+            break;
+        }
+        if (record->direction == direction && !search_result_append(&result, &capacity, i)) {
+            break;
+        }
+    }
+    
+    return result;
+}
@@ -1,12 +1,13 @@
 /**
  * @file main.c
- * @brief   
- * @author   
+ * @brief База данных репозитория
+ * @author Костопраев Дмитрий Евгеньевич
  * @date --.--.----
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <locale.h>
 #include "repository.h"
 
@@ -14,14 +15,14 @@ static int handle_load(RepositoryDB* db)
 {
     char filename[MAX_FILENAME];
     
-    printf("    : ");
+    printf("Введите имя файла для загрузки: ");
     if (!read_string(filename, MAX_FILENAME)) {
-        fprintf(stderr, "   \n");
+        fprintf(stderr, "Ошибка чтения имени файла\n");
         return 0;
     }
     
     if (db_load_from_file(db, filename)) {
-        printf("   (%d )\n", db->count);
+        printf("Данные успешно загружены (%d записей)\n", db->count);
         return 1;
     }
     
@@ -35,24 +36,24 @@ static int handle_search_direction(RepositoryDB* db)
     int i;
     
     if (db->count == 0) {
-        printf("\n  \n");
+        printf("\nБаза данных пуста\n");
         return 0;
     }
     
-    printf("\n---    ---\n");
+    printf("\n--- Поиск по направлению ---\n");
     search_direction = read_direction();
     
     result = db_search_by_direction(db, search_direction);
     
-    printf("\n===   ===\n: %s\n\n", direction_to_string(search_direction));
+    printf("\n=== Результаты поиска ===\nНаправление: %s\n\n", direction_to_string(search_direction));
     
     if (result.count == 0) {
-        printf("  \n");
+        printf("Записи не найдены\n");
     } else {
         for (i = 0; i < result.count; i++) {
             db_print_record(&db->records[result.indices[i]], result.indices[i] + 1);
         }
-        printf("\n: %d\n", result.count);
+        printf("\nНайдено: %d\n", result.count);
     }
     
     search_result_free(&result);
@@ -67,30 +68,75 @@ static int handle_search_combined(RepositoryDB* db)
     int i;
     
     if (db->count == 0) {
-        printf("\n  \n");
+        printf("\nБаза данных пуста\n");
         return 0;
     }
     
-    printf("\n---   (   ) ---\n");
+    printf("\n--- Комбинированный поиск (дата релиза И размер) ---\n");
     
-    printf("  :\n");
+    printf("Введите дату релиза:\n");
     search_date = read_date();
     
-    printf(" (): ");
+    printf("Размер (Кб): ");
     target_size = read_int();
     
     result = db_search_combined(db, search_date, target_size);
     
-    printf("\n===  ===\n:  = %02d.%02d.%04d   = %d \n\n",
+    printf("\n=== Результаты ===\nУсловия: дата = %02d.%02d.%04d И размер = %d Кб\n\n",
         search_date.day, search_date.month, search_date.year, target_size);
     
     if (result.count == 0) {
-        printf("  \n");
+        printf("Записи не найдены\n");
     } else {
         for (i = 0; i < result.count; i++) {
             db_print_record(&db->records[result.indices[i]], result.indices[i] + 1);
         }
-        printf(": %d\n", result.count);
+        printf("Найдено: %d\n", result.count);
+    }
+    
+    search_result_free(&result);
+    return 1;
+}
+
+static int handle_search_range(RepositoryDB* db)
+{
+    NumericField field;
+    int min_value;
+    int max_value;
+    SearchResult result;
+    int i;
+    
+    if (db->count == 0) {
+        printf("\nБаза данных пуста\n");
+        return 0;
+    }
+    
+    printf("\n--- Поиск по диапазону ---\n");
+    field = read_numeric_field();
+    
+    if (field == FIELD_RELEASE_DATE) {
+        printf("Начальная дата:\n");
+        min_value = date_to_key(read_date());
+        printf("Конечная дата:\n");
+        max_value = date_to_key(read_date());
+    } else {
+        printf("От: ");
+        min_value = read_int();
+        printf("До: ");
+        max_value = read_int();
+    }
+    
+    result = db_search_range(db, field, min_value, max_value);
+    
+    printf("\n=== Результаты ===\nПоле: %s\n\n", field_names[field]);
+    
+    if (result.count == 0) {
+        printf("Записи не найдены\n");
+    } else {
+        for (i = 0; i < result.count; i++) {
+            db_print_record(&db->records[result.indices[i]], result.indices[i] + 1);
+        }
+        printf("Найдено: %d\n", result.count);
     }
     
     search_result_free(&result);
@@ -99,79 +145,577 @@ static int handle_search_combined(RepositoryDB* db)
 
 static int handle_sort(RepositoryDB* db)
 {
+    char keys[MAX_STR];
+    SortSpec spec;
+    
     if (db->count == 0) {
-        printf("\n  \n");
+        printf("\nБаза данных пуста\n");
         return 0;
     }
     
-    printf("\n--- :  ->  ->   (.) ---\n");
+    printf("\n--- Сортировка ---\n");
+    printf("Поля: name, site, direction, size, date, deps, compat; направление :asc или :desc\n");
+    printf("Пусто - Название -> Направление -> Дата релиза (убыв.)\n");
+    printf("Ключи через запятую (например size:desc,name): ");
+    if (!read_string(keys, MAX_STR)) {
+        fprintf(stderr, "Ошибка чтения ключей сортировки\n");
+        return 0;
+    }
     
-    if (db_sort_bubble(db)) {
-        printf(" !\n\n");
-        db_print_all(db);
-        return 1;
+    if (keys[0] == '\0') {
+        if (!db_sort_bubble(db)) {
+            return 0;
+        }
+    } else if (!sort_spec_parse(keys, &spec) || !db_sort(db, &spec)) {
+        return 0;
     }
     
-    return 0;
+    printf("Сортировка выполнена!\n\n");
+    db_print_all(db);
+    return 1;
 }
 
 static int handle_add_record(RepositoryDB* db)
 {
     Repository new_record;
     
+    printf("\n--- Добавление записи ---\n");
     if (!read_repository_record(&new_record)) {
-        fprintf(stderr, "  \n");
+        fprintf(stderr, "Ошибка ввода записи\n");
         return 0;
     }
     
     if (db_add_record(db, &new_record)) {
-        printf("\n !\n");
+        printf("\nЗапись добавлена!\n");
         return 1;
     }
     
     return 0;
 }
 
+/* Номер записи в том виде, в каком его показывает просмотр (с 1) */
+static int read_record_number(RepositoryDB* db)
+{
+    int number;
+    
+    printf("Номер записи (1-%d): ", db->count);
+    number = read_int();
+    
+    if (number < 1 || number > db->count || db->dead[number - 1]) {
+        fprintf(stderr, "Записи с таким номером нет\n");
+        return -1;
+    }
+    
+    return number - 1;
+}
+
+static int handle_delete_record(RepositoryDB* db)
+{
+    int index;
+    
+    if (db->count - db->dead_count == 0) {
+        printf("\nБаза данных пуста\n");
+        return 0;
+    }
+    
+    printf("\n--- Удаление записи ---\n");
+    index = read_record_number(db);
+    if (index < 0) {
+        return 0;
+    }
+    
+    if (db_delete_record(db, index)) {
+        printf("Запись удалена\n");
+        return 1;
+    }
+    
+    return 0;
+}
+
+static int handle_update_record(RepositoryDB* db)
+{
+    Repository record;
+    int index;
+    
+    if (db->count - db->dead_count == 0) {
+        printf("\nБаза данных пуста\n");
+        return 0;
+    }
+    
+    printf("\n--- Изменение записи ---\n");
+    index = read_record_number(db);
+    if (index < 0) {
+        return 0;
+    }
+    
+    db_print_record(&db->records[index], index + 1);
+    printf("Введите новые значения:\n");
+    if (!read_repository_record(&record)) {
+        fprintf(stderr, "Ошибка ввода записи\n");
+        return 0;
+    }
+    
+    if (db_update_record(db, index, &record)) {
+        printf("\nЗапись изменена!\n");
+        return 1;
+    }
+    
+    return 0;
+}
+
+/*
+ * Уплотнение меняет номера записей, поэтому выполняется не внутри удаления,
+ * а перед следующей операцией, которая не ссылается на показанные номера.
+ */
+static void compact_if_pending(RepositoryDB* db)
+{
+    if (db_compact_pending(db) && db_compact(db)) {
+        printf("Удалённые записи исключены из базы, номера записей изменились\n");
+    }
+}
+
 static int handle_save(RepositoryDB* db)
 {
     char filename[MAX_FILENAME];
     
     if (db->count == 0) {
-        fprintf(stderr, "   \n");
+        fprintf(stderr, "Нет данных для сохранения\n");
         return 0;
     }
     
-    printf("  : ");
+    printf("Введите имя файла: ");
     if (!read_string(filename, MAX_FILENAME)) {
-        fprintf(stderr, "   \n");
+        fprintf(stderr, "Ошибка чтения имени файла\n");
         return 0;
     }
     
-    if (db_save_to_file(db, filename)) {
-        printf("  '%s'\n", filename);
+    if (db_save_async(db, filename)) {
+        printf("Сохранение в '%s' выполняется в фоне (пункт 12 - состояние)\n", filename);
         return 1;
     }
     
     return 0;
 }
 
-int main()
+static int print_top_k(RepositoryDB* db, const TopKQuery* query)
+{
+    SearchResult result;
+    int i;
+    
+    result = db_top_k_parallel(db, query, platform_cpu_count());
+    
+    printf("\n=== %d %s по полю \"%s\" ===\n\n", query->k,
+        query->descending ? "наибольших" : "наименьших", field_names[query->field]);
+    
+    if (result.count == 0) {
+        printf("Записи не найдены\n");
+    } else {
+        for (i = 0; i < result.count; i++) {
+            db_print_record(&db->records[result.indices[i]], result.indices[i] + 1);
+        }
+        printf("Найдено: %d\n", result.count);
+    }
+    
+    search_result_free(&result);
+    return 1;
+}
+
+static int handle_top_k(RepositoryDB* db)
+{
+    TopKQuery query;
+    
+    if (db->count - db->dead_count == 0) {
+        printf("\nБаза данных пуста\n");
+        return 0;
+    }
+    
+    printf("\n--- K лучших по полю ---\n");
+    query.field = read_numeric_field();
+    
+    printf("Сколько записей (K): ");
+    query.k = read_int();
+    if (query.k <= 0) {
+        fprintf(stderr, "Ошибка: K должно быть больше 0\n");
+        return 0;
+    }
+    
+    printf("Порядок (1 - наибольшие, 2 - наименьшие): ");
+    query.descending = read_int() != 2;
+    
+    query.direction = read_filter("Направление", dir_names, DIRECTION_COUNT);
+    query.compatibility = read_filter("Совместимость", compat_names, COMPAT_COUNT);
+    
+    return print_top_k(db, &query);
+}
+
+/* Пакетный режим: K наибольших по полю из файла, без меню */
+static int run_top_k(int argc, char* argv[])
 {
+    static const char* keys[FIELD_COUNT] = { "size", "date", "deps" };
     RepositoryDB db;
+    TopKQuery query;
+    Direction direction;
+    int ok;
+    int f;
+    
+    query.field = FIELD_COUNT;
+    for (f = 0; f < FIELD_COUNT; f++) {
+        if (strcmp(argv[3], keys[f]) == 0) {
+            query.field = (NumericField)f;
+        }
+    }
+    query.k = atoi(argv[4]);
+    query.descending = 1;
+    query.direction = -1;
+    query.compatibility = -1;
+    
+    if (query.field == FIELD_COUNT || query.k <= 0) {
+        fprintf(stderr, "Ошибка: поле size, date или deps и K > 0\n");
+        return 0;
+    }
+    if (argc >= 6) {
+        if (!string_to_direction(argv[5], &direction)) {
+            fprintf(stderr, "Ошибка: неизвестное направление '%s'\n", argv[5]);
+            return 0;
+        }
+        query.direction = direction;
+    }
+    
+    if (!db_init(&db)) {
+        return 0;
+    }
+    
+    ok = db_load_from_file(&db, argv[2]) && print_top_k(&db, &query);
+    db_free(&db);
+    return ok;
+}
+
+static int handle_lazy_open(LazyFile* lazy)
+{
+    char filename[MAX_FILENAME];
+    
+    printf("Введите имя файла: ");
+    if (!read_string(filename, MAX_FILENAME)) {
+        fprintf(stderr, "Ошибка чтения имени файла\n");
+        return 0;
+    }
+    
+    if (lazy_open(lazy, filename)) {
+        printf("Файл открыт без загрузки (%d записей)\n", lazy->count);
+        return 1;
+    }
+    
+    return 0;
+}
+
+static int handle_lazy_records(LazyFile* lazy)
+{
+    const Repository* record;
+    int from;
+    int to;
+    int i;
+    
+    if (lazy->file == NULL) {
+        printf("\nФайл не открыт\n");
+        return 0;
+    }
+    
+    printf("\n--- Записи открытого файла (1-%d) ---\n", lazy->count);
+    printf("С номера: ");
+    from = read_int();
+    printf("По номер: ");
+    to = read_int();
+    
+    if (from < 1 || to > lazy->count || from > to) {
+        fprintf(stderr, "Ошибка: некорректный диапазон номеров\n");
+        return 0;
+    }
+    
+    for (i = from - 1; i < to; i++) {
+        record = lazy_get(lazy, i);
+        if (record == NULL) {
+            return 0;
+        }
+        db_print_record(record, i + 1);
+    }
+    
+    return 1;
+}
+
+static int handle_lazy_search(LazyFile* lazy)
+{
+    Direction search_direction;
+    SearchResult result;
+    const Repository* record;
+    int i;
+    
+    if (lazy->file == NULL) {
+        printf("\nФайл не открыт\n");
+        return 0;
+    }
+    
+    printf("\n--- Поиск по направлению в открытом файле ---\n");
+    search_direction = read_direction();
+    
+    result = lazy_search_by_direction(lazy, search_direction);
+    
+    printf("\n=== Результаты поиска ===\nНаправление: %s\n\n", direction_to_string(search_direction));
+    
+    if (result.count == 0) {
+        printf("Записи не найдены\n");
+    } else {
+        for (i = 0; i < result.count; i++) {
+            record = lazy_get(lazy, result.indices[i]);
+            if (record != NULL) {
+                db_print_record(record, result.indices[i] + 1);
+            }
+        }
+        printf("\nНайдено: %d\n", result.count);
+    }
+    
+    printf("Кэш кусков: попаданий %lu, разобрано %lu\n", lazy->hits, lazy->misses);
+    search_result_free(&result);
+    return 1;
+}
+
+/* Пакетный режим: одна запись по номеру без загрузки всего файла */
+static int run_record_lookup(const char* filename, int number)
+{
+    LazyFile lazy;
+    const Repository* record;
+    int ok = 0;
+    
+    lazy_init(&lazy);
+    if (lazy_open(&lazy, filename)) {
+        record = lazy_get(&lazy, number - 1);
+        if (record != NULL) {
+            db_print_record(record, number);
+            ok = 1;
+        } else if (number < 1 || number > lazy.count) {
+            fprintf(stderr, "Записи с номером %d нет (всего %d)\n", number, lazy.count);
+        }
+    }
+    
+    lazy_close(&lazy);
+    return ok;
+}
+
+/* Пакетный режим: упорядочить файл по ключам и сохранить результат */
+static int run_sort(const char* filename, const char* keys, const char* output)
+{
+    RepositoryDB db;
+    SortSpec spec;
+    int ok;
+    
+    if (!sort_spec_parse(keys, &spec) || !db_init(&db)) {
+        return 0;
+    }
+    
+    ok = db_load_from_file(&db, filename) && db_sort(&db, &spec) && db_save_to_file(&db, output);
+    db_free(&db);
+    return ok;
+}
+
+/* Пакетный режим: замер специализированной и общей сортировки */
+static int run_sort_benchmark(const char* filename, const char* keys, int rounds)
+{
+    RepositoryDB db;
+    SortSpec spec;
+    int ok;
+    
+    if (!sort_spec_parse(keys, &spec) || !db_init(&db)) {
+        return 0;
+    }
+    
+    ok = db_load_from_file(&db, filename);
+    if (ok) {
+        printf("Записей: %d, ключи: %s, повторов: %d\n", db.count, keys, rounds);
+        ok = sort_benchmark(&db, &spec, rounds);
+    }
+    db_free(&db);
+    return ok;
+}
+
+static int handle_sketches(RepositoryDB* db)
+{
+    if (db->count - db->dead_count == 0) {
+        printf("\nБаза данных пуста\n");
+        return 0;
+    }
+    
+    printf("Порог размера для подсчёта записей, Кб (-1 - не считать): ");
+    return db_print_sketches(db, read_int());
+}
+
+/* Пакетный режим: приближённая статистика файла */
+static int run_sketches(const char* filename, int threshold)
+{
+    RepositoryDB db;
+    int ok;
+    
+    if (!db_init(&db)) {
+        return 0;
+    }
+    
+    ok = db_load_from_file(&db, filename) && db_print_sketches(&db, threshold);
+    db_free(&db);
+    return ok;
+}
+
+static void print_merge_stats(RepositoryDB* db, const MergeStats* stats)
+{
+    printf("Объединено записей: %d из %d, повторов: %d (заменено более новыми: %d)\n",
+        db->count, stats->input_records, stats->duplicates, stats->replaced);
+    if (stats->unsorted_inputs > 0) {
+        printf("Неупорядоченных файлов (отсортированы перед слиянием): %d\n", stats->unsorted_inputs);
+    }
+}
+
+static int handle_merge(RepositoryDB* db)
+{
+    char filenames[MERGE_MAX_FILES][MAX_FILENAME];
+    const char* names[MERGE_MAX_FILES];
+    MergeStats stats;
+    MergePolicy policy;
+    int count;
+    int i;
+    
+    printf("\n--- Объединение файлов ---\n");
+    printf("Количество файлов (1-%d): ", MERGE_MAX_FILES);
+    count = read_int();
+    if (count < 1 || count > MERGE_MAX_FILES) {
+        fprintf(stderr, "Ошибка: некорректное количество файлов\n");
+        return 0;
+    }
+    
+    for (i = 0; i < count; i++) {
+        printf("Файл %d: ", i + 1);
+        if (!read_string(filenames[i], MAX_FILENAME)) {
+            fprintf(stderr, "Ошибка чтения имени файла\n");
+            return 0;
+        }
+        names[i] = filenames[i];
+    }
+    
+    printf("При совпадении названия и сайта оставлять:\n");
+    printf("0. Первую запись\n1. Запись с более новым релизом\nВыбор: ");
+    policy = read_int() == 1 ? MERGE_NEWEST : MERGE_KEEP_FIRST;
+    
+    if (!db_merge_files(db, names, count, policy, &stats)) {
+        return 0;
+    }
+    
+    print_merge_stats(db, &stats);
+    return 1;
+}
+
+/* Пакетный режим: объединить файлы и сохранить результат */
+static int run_merge(int argc, char* argv[])
+{
+    RepositoryDB db;
+    MergeStats stats;
+    MergePolicy policy = MERGE_KEEP_FIRST;
+    int first = 2;
+    int ok;
+    
+    if (strcmp(argv[first], "--newest") == 0) {
+        policy = MERGE_NEWEST;
+        first++;
+    }
+    if (argc - first < 2) {
+        fprintf(stderr, "Ошибка: нужны имя результата и хотя бы один файл\n");
+        return 0;
+    }
+    
+    if (!db_init(&db)) {
+        return 0;
+    }
+    
+    ok = db_merge_files(&db, (const char* const*)&argv[first + 1], argc - first - 1, policy, &stats);
+    if (ok) {
+        print_merge_stats(&db, &stats);
+        ok = db_save_to_file(&db, argv[first]);
+    }
+    db_free(&db);
+    return ok;
+}
+
+static int print_usage(const char* program)
+{
+    printf("Использование:\n");
+    printf("  %s                                   - интерактивное меню\n", program);
+    printf("  %s --server <сокет> [файл]           - сервер запросов\n", program);
+    printf("  %s --loadgen <сокет> [запросов] [конвейер] - генератор нагрузки\n", program);
+    printf("  %s --top <файл> <size|date|deps> <K> [направление] - K наибольших\n", program);
+    printf("  %s --record <файл> <номер>               - запись без загрузки файла\n", program);
+    printf("  %s --merge [--newest] <результат> <файл>... - объединение файлов\n", program);
+    printf("  %s --sort <файл> <ключи> <результат>     - сортировка по ключам\n", program);
+    printf("  %s --sort-bench <файл> <ключи> [повторов] - замер сортировки\n", program);
+    printf("  %s --sketch <файл> [порог размера]      - приближённая статистика\n", program);
+    printf("  %s --stress [читателей] [изменений]     - проверка версий под нагрузкой\n", program);
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    RepositoryDB db;
+    LazyFile lazy;
     int running = 1;
     int choice;
     
     setlocale(LC_ALL, "");
     
-    printf("===    ===\n\n");
+    if (argc >= 3 && strcmp(argv[1], "--server") == 0) {
+        return run_server(argv[2], argc >= 4 ? argv[3] : NULL) ? 0 : 1;
+    }
+    if (argc >= 3 && strcmp(argv[1], "--loadgen") == 0) {
+        return run_loadgen(argv[2], argc >= 4 ? atoi(argv[3]) : 100000,
+                           argc >= 5 ? atoi(argv[4]) : 32) ? 0 : 1;
+    }
+    if (argc >= 5 && strcmp(argv[1], "--top") == 0) {
+        return run_top_k(argc, argv) ? 0 : 1;
+    }
+    if (argc >= 4 && strcmp(argv[1], "--record") == 0) {
+        return run_record_lookup(argv[2], atoi(argv[3])) ? 0 : 1;
+    }
+    if (argc >= 4 && strcmp(argv[1], "--merge") == 0) {
+        return run_merge(argc, argv) ? 0 : 1;
+    }
+    if (argc >= 5 && strcmp(argv[1], "--sort") == 0) {
+        return run_sort(argv[2], argv[3], argv[4]) ? 0 : 1;
+    }
+    if (argc >= 3 && strcmp(argv[1], "--sketch") == 0) {
+        return run_sketches(argv[2], argc >= 4 ? atoi(argv[3]) : -1) ? 0 : 1;
+    }
+    if (argc >= 4 && strcmp(argv[1], "--sort-bench") == 0) {
+        return run_sort_benchmark(argv[2], argv[3], argc >= 5 ? atoi(argv[4]) : 5) ? 0 : 1;
+    }
+    if (argc >= 2 && strcmp(argv[1], "--stress") == 0) {
+        return snapshot_stress_test(argc >= 3 ? atoi(argv[2]) : 4,
+                                    argc >= 4 ? atoi(argv[3]) : 20000) ? 0 : 1;
+    }
+    if (argc > 1) {
+        return print_usage(argv[0]);
+    }
+    
+    printf("=== База данных репозитория ===\n\n");
     
     if (!db_init(&db)) {
-        fprintf(stderr, " :    \n");
+        fprintf(stderr, "Критическая ошибка: не удалось инициализировать БД\n");
         return 1;
     }
+    lazy_init(&lazy);
     
     while (running) {
+        /* Ход фонового сохранения и его итог выводятся перед каждым меню */
+        if (db.save.active) {
+            db_save_poll(&db);
+        }
+        
         choice = show_menu();
+        if (choice != 10 && choice != 11 && choice != 19) {
+            compact_if_pending(&db);
+        }
         
         switch (choice) {
             case 1:
@@ -203,16 +747,68 @@ int main()
                 break;
                 
             case 8:
+                handle_search_range(&db);
+                break;
+                
+            case 9:
+                db_print_stats(&db);
+                break;
+                
+            case 10:
+                handle_delete_record(&db);
+                break;
+                
+            case 11:
+                handle_update_record(&db);
+                break;
+                
+            case 12:
+                if (db.save.active) {
+                    db_save_poll(&db);
+                } else {
+                    printf("Фоновое сохранение не выполняется\n");
+                }
+                break;
+                
+            case 13:
+                handle_top_k(&db);
+                break;
+                
+            case 14:
+                handle_lazy_open(&lazy);
+                break;
+                
+            case 15:
+                handle_lazy_records(&lazy);
+                break;
+                
+            case 16:
+                handle_lazy_search(&lazy);
+                break;
+                
+            case 17:
+                handle_merge(&db);
+                break;
+                
+            case 18:
+                handle_sketches(&db);
+                break;
+                
+            case 19:
+                if (!db_save_wait(&db)) {
+                    fprintf(stderr, "Фоновое сохранение в '%s' не выполнено\n", db.save.filename);
+                }
                 running = 0;
-                printf("\n !\n");
+                printf("\nДо свидания!\n");
                 break;
                 
             default:
-                printf(" \n");
+                printf("Неверный выбор\n");
                 break;
         }
     }
     
+    lazy_close(&lazy);
     db_free(&db);
     
     return 0;
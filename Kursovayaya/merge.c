@@ -0,0 +1,392 @@
+/**
+ * @file merge.c
+ * @brief База данных репозитория - объединение нескольких файлов
+ * @author Костопраев Дмитрий Евгеньевич
+ *
+ * Файлы разбираются параллельно, по файлу на поток, прямо в массивы
+ * записей без промежуточной БД (любой поддерживаемый формат). Каждый
+ * массив упорядочивается по compare_records, если он ещё не упорядочен,
+ * с сохранением исходного порядка равных записей, затем
+ * k-путевое слияние через кучу выдаёт записи в общем порядке. Повторы
+ * по паре (название, сайт) отсекаются хеш-множеством: остаётся первая
+ * запись в порядке слияния или, по выбору, запись с более новым релизом.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "repository.h"
+
+typedef struct {
+    const char* filename;
+    Repository* records;
+    int count;
+    int sorted;
+    int ok;
+} MergeInput;
+
+typedef struct {
+    MergeInput* inputs;
+    int count;
+    volatile long next;
+} MergeLoad;
+
+/* Куча номеров входов: в корне вход с наименьшей текущей записью */
+typedef struct {
+    MergeInput* inputs;
+    int* positions;
+    int* items;
+    int count;
+} MergeHeap;
+
+/* Множество пар (название, сайт): номера записей результата, -1 - пусто */
+typedef struct {
+    int* table;
+    size_t size;
+} KeySet;
+
+/* Равные записи упорядочиваются по адресу, то есть по исходному положению в массиве */
+static int compare_record_ptrs(const void* a, const void* b)
+{
+    const Repository* x = *(const Repository* const*)a;
+    const Repository* y = *(const Repository* const*)b;
+    int cmp = compare_records(x, y);
+    
+    return cmp != 0 ? cmp : (x > y) - (x < y);
+}
+
+/*
+ * Устойчиво упорядочить записи входа: qsort сортирует указатели с разрывом
+ * ничьих по исходному положению, затем записи переставляются в новый массив.
+ * Иначе из повторов при слиянии оставалась бы произвольная запись.
+ */
+static int sort_input(MergeInput* input)
+{
+    const Repository** order;
+    Repository* sorted;
+    int i;
+    
+    order = (const Repository**)malloc(input->count * sizeof(Repository*));
+    sorted = (Repository*)malloc(input->count * sizeof(Repository));
+    if (order == NULL || sorted == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для сортировки\n");
+        free(order);
+        free(sorted);
+        return 0;
+    }
+    
+    for (i = 0; i < input->count; i++) {
+        order[i] = &input->records[i];
+    }
+    qsort(order, input->count, sizeof(Repository*), compare_record_ptrs);
+    for (i = 0; i < input->count; i++) {
+        sorted[i] = *order[i];
+    }
+    
+    free(order);
+    free(input->records);
+    input->records = sorted;
+    return 1;
+}
+
+/* Прочитать один файл в массив записей и упорядочить его */
+static int load_input(MergeInput* input)
+{
+    RecordList list;
+    int i;
+    
+    if (!read_records_file(input->filename, &list)) {
+        return 0;
+    }
+    
+    input->records = list.records;
+    input->count = list.count;
+    
+    input->sorted = 1;
+    for (i = 1; i < input->count && input->sorted; i++) {
+        input->sorted = compare_records(&input->records[i - 1], &input->records[i]) <= 0;
+    }
+    return input->sorted || sort_input(input);
+}
+
+static int load_worker(void* arg)
+{
+    MergeLoad* load = (MergeLoad*)arg;
+    long i;
+    
+    while ((i = platform_atomic_inc(&load->next) - 1) < load->count) {
+        load->inputs[i].ok = load_input(&load->inputs[i]);
+        if (!load->inputs[i].ok) {
+            fprintf(stderr, "Ошибка загрузки файла '%s'\n", load->inputs[i].filename);
+        }
+    }
+    return 1;
+}
+
+/* Разобрать все входы: не больше потоков, чем процессоров и файлов */
+static int load_inputs(MergeInput* inputs, int count)
+{
+    MergeLoad load;
+    platform_thread* threads;
+    int thread_count = platform_cpu_count();
+    int started = 0;
+    int ok = 1;
+    int t;
+    
+    load.inputs = inputs;
+    load.count = count;
+    load.next = 0;
+    
+    if (thread_count > count) {
+        thread_count = count;
+    }
+    threads = (platform_thread*)malloc(thread_count * sizeof(platform_thread));
+    if (threads == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для потоков загрузки\n");
+        return 0;
+    }
+    
+    /* Текущий поток тоже разбирает файлы */
+    for (t = 0; t < thread_count - 1; t++) {
+        if (!platform_thread_create(&threads[t], load_worker, &load)) {
+            break;
+        }
+        started++;
+    }
+    load_worker(&load);
+    for (t = 0; t < started; t++) {
+        platform_thread_join(threads[t]);
+    }
+    free(threads);
+    
+    for (t = 0; t < count; t++) {
+        ok = ok && inputs[t].ok;
+    }
+    return ok;
+}
+
+/* a раньше b: при равных записях раньше идёт вход с меньшим номером */
+static int heap_less(const MergeHeap* heap, int a, int b)
+{
+    int cmp = compare_records(&heap->inputs[a].records[heap->positions[a]],
+                              &heap->inputs[b].records[heap->positions[b]]);
+    
+    return cmp != 0 ? cmp < 0 : a < b;
+}
+
+static void heap_sift_down(MergeHeap* heap, int pos)
+{
+    int child;
+    int temp;
+    
+    while ((child = 2 * pos + 1) < heap->count) {
+        if (child + 1 < heap->count && heap_less(heap, heap->items[child + 1], heap->items[child])) {
+            child++;
+        }
+        if (!heap_less(heap, heap->items[child], heap->items[pos])) {
+            break;
+        }
+        temp = heap->items[pos];
+        heap->items[pos] = heap->items[child];
+        heap->items[child] = temp;
+        pos = child;
+    }
+}
+
+static unsigned long key_hash(const Repository* record)
+{
+    unsigned long hash = 2166136261u;
+    const char* p;
+    
+    for (p = record->name; *p != '\0'; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    hash = (hash ^ 0xFF) * 16777619u;
+    for (p = record->site; *p != '\0'; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return hash;
+}
+
+/* Таблица не меньше чем вдвое больше числа ключей; размер считается в size_t */
+static int key_set_init(KeySet* set, int expected)
+{
+    set->size = 16;
+    while (set->size / 2 < (size_t)expected) {
+        if (set->size > ((size_t)-1 / sizeof(int)) / 2) {
+            fprintf(stderr, "Ошибка: слишком много записей для поиска повторов\n");
+            return 0;
+        }
+        set->size *= 2;
+    }
+    
+    set->table = (int*)malloc(set->size * sizeof(int));
+    if (set->table == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для поиска повторов\n");
+        return 0;
+    }
+    
+    memset(set->table, -1, set->size * sizeof(int));
+    return 1;
+}
+
+/* Ячейка таблицы для ключа записи: занятая этим ключом или первая пустая */
+static int* key_set_slot(KeySet* set, const Repository* records, const Repository* record)
+{
+    size_t slot = key_hash(record) & (set->size - 1);
+    const Repository* other;
+    
+    while (set->table[slot] >= 0) {
+        other = &records[set->table[slot]];
+        if (strcmp(other->name, record->name) == 0 && strcmp(other->site, record->site) == 0) {
+            break;
+        }
+        slot = (slot + 1) & (set->size - 1);
+    }
+    return &set->table[slot];
+}
+
+/*
+ * Слить упорядоченные входы в out. Вытесненная более новым релизом запись
+ * помечается в dropped, новая добавляется в конец: порядок слияния
+ * неубывающий, поэтому результат остаётся упорядоченным.
+ */
+static int merge_inputs(MergeInput* inputs, int input_count, Repository* out, int total,
+                        MergePolicy policy, MergeStats* stats)
+{
+    MergeHeap heap;
+    KeySet keys;
+    unsigned char* dropped;
+    const Repository* record;
+    int* slot;
+    int count = 0;
+    int kept;
+    int i;
+    
+    heap.inputs = inputs;
+    heap.positions = (int*)calloc(input_count, sizeof(int));
+    heap.items = (int*)malloc(input_count * sizeof(int));
+    dropped = (unsigned char*)calloc(total > 0 ? total : 1, 1);
+    if (heap.positions == NULL || heap.items == NULL || dropped == NULL ||
+        !key_set_init(&keys, total)) {
+        fprintf(stderr, "Ошибка выделения памяти для слияния\n");
+        free(heap.positions);
+        free(heap.items);
+        free(dropped);
+        return -1;
+    }
+    
+    heap.count = 0;
+    for (i = 0; i < input_count; i++) {
+        if (inputs[i].count > 0) {
+            heap.items[heap.count++] = i;
+        }
+    }
+    for (i = heap.count / 2 - 1; i >= 0; i--) {
+        heap_sift_down(&heap, i);
+    }
+    
+    while (heap.count > 0) {
+        i = heap.items[0];
+        record = &inputs[i].records[heap.positions[i]];
+        
+        slot = key_set_slot(&keys, out, record);
+        if (*slot < 0) {
+            *slot = count;
+            out[count++] = *record;
+        } else {
+            stats->duplicates++;
+            if (policy == MERGE_NEWEST &&
+                compare_dates(record->release_date, out[*slot].release_date) > 0) {
+                dropped[*slot] = 1;
+                *slot = count;
+                out[count++] = *record;
+                stats->replaced++;
+            }
+        }
+        
+        if (++heap.positions[i] == inputs[i].count) {
+            heap.items[0] = heap.items[--heap.count];
+        }
+        heap_sift_down(&heap, 0);
+    }
+    
+    kept = 0;
+    for (i = 0; i < count; i++) {
+        if (!dropped[i]) {
+            out[kept++] = out[i];
+        }
+    }
+    
+    free(keys.table);
+    free(heap.positions);
+    free(heap.items);
+    free(dropped);
+    return kept;
+}
+
+/*
+ * Загрузить и объединить файлы в db вместо текущих записей. Результат
+ * упорядочен по compare_records, повторы (название, сайт) удалены.
+ * stats может быть NULL. Если файл не загрузился или слияние не удалось,
+ * БД не меняется (о нехватке памяти при замене см. db_replace_records).
+ */
+int db_merge_files(RepositoryDB* db, const char* const* filenames, int file_count,
+                   MergePolicy policy, MergeStats* stats)
+{
+    MergeInput* inputs;
+    MergeStats local;
+    Repository* out = NULL;
+    long long total = 0;
+    int count = -1;
+    int i;
+    
+    if (db == NULL || filenames == NULL || file_count <= 0) {
+        fprintf(stderr, "Ошибка: некорректные параметры в db_merge_files\n");
+        return 0;
+    }
+    
+    if (stats == NULL) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof(MergeStats));
+    
+    inputs = (MergeInput*)calloc(file_count, sizeof(MergeInput));
+    if (inputs == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для слияния\n");
+        return 0;
+    }
+    for (i = 0; i < file_count; i++) {
+        inputs[i].filename = filenames[i];
+    }
+    
+    if (load_inputs(inputs, file_count)) {
+        for (i = 0; i < file_count; i++) {
+            total += inputs[i].count;
+            stats->unsorted_inputs += !inputs[i].sorted;
+        }
+        stats->input_records = total > 0x7FFFFFFF ? 0x7FFFFFFF : (int)total;
+        
+        if (total > 0x7FFFFFFF) {
+            fprintf(stderr, "Ошибка: слишком много записей для объединения\n");
+        } else if ((out = (Repository*)malloc((total > 0 ? total : 1) * sizeof(Repository))) == NULL) {
+            fprintf(stderr, "Ошибка выделения памяти для слияния\n");
+        } else {
+            count = merge_inputs(inputs, file_count, out, (int)total, policy, stats);
+        }
+    }
+    
+    for (i = 0; i < file_count; i++) {
+        free(inputs[i].records);
+    }
+    free(inputs);
+    
+    if (count == 0) {
+        fprintf(stderr, "Файлы не содержат записей\n");
+    }
+    if (count <= 0) {
+        free(out);
+        return 0;
+    }
+    return db_replace_records(db, out, count, (int)total, NULL, 0, NULL);
+}
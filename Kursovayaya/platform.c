@@ -0,0 +1,300 @@
+/**
+ * @file platform.c
+ * @brief База данных репозитория - потоки, мьютексы, атомарные счётчики и надёжная запись файлов
+ * @author Костопраев Дмитрий Евгеньевич
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "platform.h"
+
+#ifdef _WIN32
+#include <process.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+typedef struct {
+    platform_thread_func func;
+    void* arg;
+} ThreadStart;
+
+#ifdef _WIN32
+static unsigned __stdcall thread_trampoline(void* param)
+#else
+static void* thread_trampoline(void* param)
+#endif
+{
+    ThreadStart start = *(ThreadStart*)param;
+    
+    free(param);
+    start.func(start.arg);
+
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int platform_mutex_init(platform_mutex* mutex)
+{
+    if (mutex == NULL) {
+        return 0;
+    }
+
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+    return 1;
+#else
+    return pthread_mutex_init(mutex, NULL) == 0;
+#endif
+}
+
+int platform_mutex_destroy(platform_mutex* mutex)
+{
+    if (mutex == NULL) {
+        return 0;
+    }
+
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+    return 1;
+#else
+    return pthread_mutex_destroy(mutex) == 0;
+#endif
+}
+
+int platform_mutex_lock(platform_mutex* mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+    return 1;
+#else
+    return pthread_mutex_lock(mutex) == 0;
+#endif
+}
+
+int platform_mutex_unlock(platform_mutex* mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+    return 1;
+#else
+    return pthread_mutex_unlock(mutex) == 0;
+#endif
+}
+
+int platform_thread_create(platform_thread* thread, platform_thread_func func, void* arg)
+{
+    ThreadStart* start;
+    
+    if (thread == NULL || func == NULL) {
+        fprintf(stderr, "Ошибка: некорректные параметры в platform_thread_create\n");
+        return 0;
+    }
+    
+    start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (start == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для потока\n");
+        return 0;
+    }
+    start->func = func;
+    start->arg = arg;
+
+#ifdef _WIN32
+    *thread = (HANDLE)_beginthreadex(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*thread == 0) {
+#else
+    if (pthread_create(thread, NULL, thread_trampoline, start) != 0) {
+#endif
+        fprintf(stderr, "Ошибка создания потока\n");
+        free(start);
+        return 0;
+    }
+    
+    return 1;
+}
+
+int platform_thread_join(platform_thread thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+    return 1;
+#else
+    return pthread_join(thread, NULL) == 0;
+#endif
+}
+
+int platform_cpu_count()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+long platform_atomic_inc(volatile long* value)
+{
+#ifdef _WIN32
+    return InterlockedIncrement(value);
+#else
+    return __sync_add_and_fetch(value, 1);
+#endif
+}
+
+long platform_atomic_dec(volatile long* value)
+{
+#ifdef _WIN32
+    return InterlockedDecrement(value);
+#else
+    return __sync_sub_and_fetch(value, 1);
+#endif
+}
+
+/* Сбросить буферы библиотеки и ОС: после возврата данные файла на диске */
+int platform_file_sync(FILE* file)
+{
+    if (file == NULL || fflush(file) != 0) {
+        return 0;
+    }
+
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+/*
+ * Атомарно заменить target файлом source: читатель видит либо старый файл,
+ * либо новый целиком. В POSIX дополнительно синхронизируется каталог,
+ * чтобы переименование пережило сбой питания.
+ */
+int platform_replace_file(const char* source, const char* target)
+{
+#ifdef _WIN32
+    if (!MoveFileExA(source, target, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        fprintf(stderr, "Ошибка замены файла '%s'\n", target);
+        return 0;
+    }
+    return 1;
+#else
+    char dir[4096];
+    const char* slash;
+    int fd;
+    
+    if (rename(source, target) != 0) {
+        perror("Ошибка замены файла");
+        return 0;
+    }
+    
+    slash = strrchr(target, '/');
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else if (slash == target) {
+        strcpy(dir, "/");
+    } else if ((size_t)(slash - target) < sizeof(dir)) {
+        memcpy(dir, target, slash - target);
+        dir[slash - target] = '\0';
+    } else {
+        return 1;
+    }
+    
+    fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    return 1;
+#endif
+}
+
+/* Позиционирование с 64-битным смещением: файлы данных бывают больше 2 Гб */
+int platform_seek(FILE* file, long long offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+/* Размер и время изменения файла: по ним проверяется, не устарел ли индекс */
+int platform_file_info(const char* filename, long long* size, long long* mtime)
+{
+#ifdef _WIN32
+    struct __stat64 info;
+    
+    if (_stat64(filename, &info) != 0) {
+        return 0;
+    }
+#else
+    struct stat info;
+    
+    if (stat(filename, &info) != 0) {
+        return 0;
+    }
+#endif
+
+    *size = (long long)info.st_size;
+    *mtime = (long long)info.st_mtime;
+    return 1;
+}
+
+/* Размер открытого файла; ftell в Windows ограничен 2 Гб */
+int platform_file_size(FILE* file, long long* size)
+{
+#ifdef _WIN32
+    struct __stat64 info;
+    
+    if (_fstat64(_fileno(file), &info) != 0) {
+        return 0;
+    }
+#else
+    struct stat info;
+    
+    if (fstat(fileno(file), &info) != 0) {
+        return 0;
+    }
+#endif
+
+    *size = (long long)info.st_size;
+    return 1;
+}
+
+/* Монотонное время в миллисекундах для замеров */
+double platform_time_ms()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart * 1000.0 / frequency.QuadPart;
+#else
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif
+}
@@ -0,0 +1,41 @@
+/**
+ * @file platform.h
+ * @brief База данных репозитория - потоки, мьютексы, атомарные счётчики и надёжная запись файлов
+ * @author Костопраев Дмитрий Евгеньевич
+ */
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef CRITICAL_SECTION platform_mutex;
+typedef HANDLE platform_thread;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t platform_mutex;
+typedef pthread_t platform_thread;
+#endif
+
+typedef int (*platform_thread_func)(void* arg);
+
+int platform_mutex_init(platform_mutex* mutex);
+int platform_mutex_destroy(platform_mutex* mutex);
+int platform_mutex_lock(platform_mutex* mutex);
+int platform_mutex_unlock(platform_mutex* mutex);
+int platform_thread_create(platform_thread* thread, platform_thread_func func, void* arg);
+int platform_thread_join(platform_thread thread);
+int platform_cpu_count();
+long platform_atomic_inc(volatile long* value);
+long platform_atomic_dec(volatile long* value);
+int platform_file_sync(FILE* file);
+int platform_replace_file(const char* source, const char* target);
+int platform_seek(FILE* file, long long offset);
+int platform_file_info(const char* filename, long long* size, long long* mtime);
+int platform_file_size(FILE* file, long long* size);
+double platform_time_ms();
+
+#endif
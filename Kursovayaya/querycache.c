@@ -0,0 +1,177 @@
+/**
+ * @file querycache.c
+ * @brief База данных репозитория - кэш результатов поиска
+ * @author Костопраев Дмитрий Евгеньевич
+ *
+ * Результат поиска хранится вместе с версией БД, на которой он получен.
+ * Любое изменение (добавление, загрузка, сортировка) увеличивает версию,
+ * и устаревшие записи кэша больше не совпадают. Попадание возвращает общий
+ * массив индексов со счётчиком ссылок - без просмотра записей и без выделения памяти.
+ *
+ * Кэш ограничен и числом записей (QUERY_CACHE_SIZE), и памятью под индексы
+ * (QUERY_CACHE_BYTES): давно не использованные записи вытесняются, пока
+ * новый результат не поместится. Результат больше QUERY_CACHE_MAX_RESULT
+ * не кэшируется вовсе - широкий запрос по большой базе иначе вытеснил бы
+ * всё остальное и удерживал бы память после того, как стал не нужен.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "repository.h"
+
+int query_cache_release(CachedIndices* shared)
+{
+    if (shared == NULL) {
+        return 0;
+    }
+    
+    if (platform_atomic_dec(&shared->refs) == 0) {
+        free(shared->indices);
+        free(shared);
+    }
+    return 1;
+}
+
+static void entry_clear(QueryCache* cache, QueryCacheEntry* entry)
+{
+    if (entry->shared != NULL) {
+        cache->bytes -= (size_t)entry->shared->count * sizeof(int);
+        query_cache_release(entry->shared);
+    }
+    entry->shared = NULL;
+    entry->kind = QUERY_NONE;
+}
+
+int query_cache_init(QueryCache* cache)
+{
+    int i;
+    
+    if (cache == NULL) {
+        return 0;
+    }
+    
+    for (i = 0; i < QUERY_CACHE_SIZE; i++) {
+        cache->entries[i].kind = QUERY_NONE;
+        cache->entries[i].shared = NULL;
+    }
+    cache->bytes = 0;
+    cache->tick = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    return 1;
+}
+
+int query_cache_clear(QueryCache* cache)
+{
+    int i;
+    
+    if (cache == NULL) {
+        return 0;
+    }
+    
+    for (i = 0; i < QUERY_CACHE_SIZE; i++) {
+        entry_clear(cache, &cache->entries[i]);
+    }
+    return 1;
+}
+
+/* Найти результат запроса для текущей версии БД; устаревшие записи освобождаются */
+int query_cache_lookup(RepositoryDB* db, QueryKind kind, const int* params, SearchResult* result)
+{
+    QueryCacheEntry* entry;
+    int i;
+    
+    for (i = 0; i < QUERY_CACHE_SIZE; i++) {
+        entry = &db->cache.entries[i];
+        if (entry->kind == QUERY_NONE) {
+            continue;
+        }
+        
+        if (entry->version != db->version) {
+            entry_clear(&db->cache, entry);
+            continue;
+        }
+        
+        if (entry->kind == kind && memcmp(entry->params, params, sizeof(entry->params)) == 0) {
+            platform_atomic_inc(&entry->shared->refs);
+            entry->last_used = ++db->cache.tick;
+            result->indices = entry->shared->indices;
+            result->count = entry->shared->count;
+            result->shared = entry->shared;
+            db->cache.hits++;
+            return 1;
+        }
+    }
+    
+    db->cache.misses++;
+    return 0;
+}
+
+/*
+ * Передать свежий результат в кэш: его массив индексов без копирования
+ * становится общим, result начинает ссылаться на него. Давно не
+ * использованные записи вытесняются, пока не освободятся ячейка и память.
+ */
+int query_cache_store(RepositoryDB* db, QueryKind kind, const int* params, SearchResult* result)
+{
+    QueryCacheEntry* victim;
+    QueryCacheEntry* empty;
+    CachedIndices* shared;
+    size_t size = (size_t)result->count * sizeof(int);
+    int* indices;
+    int i;
+    
+    if (result->shared != NULL || size > QUERY_CACHE_MAX_RESULT) {
+        return 1;
+    }
+    
+    shared = (CachedIndices*)malloc(sizeof(CachedIndices));
+    if (shared == NULL) {
+        return 0;
+    }
+    
+    while (1) {
+        victim = NULL;
+        empty = NULL;
+        for (i = 0; i < QUERY_CACHE_SIZE; i++) {
+            if (db->cache.entries[i].kind == QUERY_NONE) {
+                if (empty == NULL) {
+                    empty = &db->cache.entries[i];
+                }
+            } else if (victim == NULL || db->cache.entries[i].last_used < victim->last_used) {
+                victim = &db->cache.entries[i];
+            }
+        }
+        
+        if (empty != NULL && db->cache.bytes + size <= QUERY_CACHE_BYTES) {
+            break;
+        }
+        entry_clear(&db->cache, victim);
+    }
+    
+    /* Запас ёмкости от роста массива при поиске в кэше не нужен */
+    indices = result->indices;
+    if (result->count > 0) {
+        indices = (int*)realloc(result->indices, size);
+        if (indices == NULL) {
+            indices = result->indices;
+        }
+    }
+    
+    shared->refs = 2;
+    shared->count = result->count;
+    shared->indices = indices;
+    db->cache.bytes += size;
+    
+    victim = empty;
+    victim->kind = kind;
+    memcpy(victim->params, params, sizeof(victim->params));
+    victim->version = db->version;
+    victim->last_used = ++db->cache.tick;
+    victim->shared = shared;
+    
+    result->indices = shared->indices;
+    result->shared = shared;
+    return 1;
+}
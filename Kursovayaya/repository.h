@@ -1,18 +1,45 @@
 /**
  * @file repository.h
- * @brief   
- * @author   
+ * @brief База данных репозитория
+ * @author Костопраев Дмитрий Евгеньевич
  */
 
 #ifndef REPOSITORY_H
 #define REPOSITORY_H
 
 #include <stdio.h>
+#include "platform.h"
 
 #define MAX_STR 50
 #define MAX_LONG_STR 100
 #define INITIAL_CAPACITY 10
 #define MAX_FILENAME 256
+#define SNAPSHOT_CHUNK_SIZE 256
+#define PROTO_MAX_FRAME 4096
+#define ZONE_BLOCK_SIZE 4096          /* кратно SNAPSHOT_CHUNK_SIZE */
+#define ARCHIVE_BLOCK_SIZE ZONE_BLOCK_SIZE
+#define ARCHIVE_EXTENSION ".rpa"
+#define CSV_EXTENSION ".csv"
+#define JSONL_EXTENSION ".jsonl"
+#define QUERY_CACHE_SIZE 32
+#define QUERY_CACHE_BYTES ((size_t)64 << 20)              /* предел памяти под индексы в кэше */
+#define QUERY_CACHE_MAX_RESULT (QUERY_CACHE_BYTES / 8)   /* больший результат не кэшируется */
+#define SAVE_BUFFER_SIZE (1 << 20)
+#define TOPK_PARALLEL_MIN_RECORDS 65536
+#define LAZY_CHUNK_SIZE 256
+#define MERGE_MAX_FILES 16
+#define SORT_MAX_KEYS 4
+#define HLL_PRECISION 12
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+#define CMS_DEPTH 4
+#define CMS_WIDTH 4096
+#define HEAVY_HITTERS 10
+#define QUANTILE_ALPHA 0.01
+#define QUANTILE_BINS 1100            /* покрывает значения до INT_MAX при QUANTILE_ALPHA */
+#define SKETCH_PARALLEL_MIN_RECORDS 65536
+#define LAZY_CACHE_CHUNKS 64
+#define LAZY_INDEX_EXTENSION ".idx"
+#define COMPACT_THRESHOLD_PERCENT 25  /* доля надгробий, после которой нужно уплотнение */
 
 typedef enum {
     DIRECTION_BACKEND = 0,
@@ -31,6 +58,20 @@ typedef enum {
     COMPAT_COUNT
 } Compatibility;
 
+/* Операции и статусы протокола сервера (server.c) */
+typedef enum {
+    PROTO_SEARCH_DIRECTION = 1,
+    PROTO_SEARCH_COMBINED,
+    PROTO_AGGREGATE,
+    PROTO_ADD,
+    PROTO_SAVE
+} ProtoOp;
+
+typedef enum {
+    PROTO_OK = 0,
+    PROTO_ERROR
+} ProtoStatus;
+
 typedef struct {
     int day;
     int month;
@@ -47,32 +88,269 @@ typedef struct {
     Compatibility compatibility;
 } Repository;
 
+typedef enum {
+    FIELD_SIZE = 0,
+    FIELD_RELEASE_DATE,
+    FIELD_DEPENDENCIES,
+    FIELD_COUNT
+} NumericField;
+
+/* Сводка блока из ZONE_BLOCK_SIZE записей: диапазоны числовых полей и маски перечислений */
+typedef struct {
+    int min[FIELD_COUNT];
+    int max[FIELD_COUNT];
+    unsigned char direction_mask;
+    unsigned char compat_mask;
+} ZoneMap;
+
+/* Регистры HyperLogLog: максимальный ранг хеша в каждом */
+typedef struct {
+    unsigned char registers[HLL_REGISTERS];
+} HyperLogLog;
+
+typedef struct {
+    char value[MAX_LONG_STR];
+    unsigned long long hash;
+    unsigned int count;
+} HeavyHitter;
+
+/* Count-Min и кандидаты в самые частые значения */
+typedef struct {
+    unsigned int counts[CMS_DEPTH][CMS_WIDTH];
+    HeavyHitter top[HEAVY_HITTERS];
+    int top_count;
+} FrequencySketch;
+
+/* Логарифмические корзины: bins[k] - значения из (gamma^(k-1), gamma^k] */
+typedef struct {
+    unsigned int total;
+    unsigned int zeros;
+    int min;
+    int max;
+    unsigned int bins[QUANTILE_BINS];
+} QuantileSketch;
+
+typedef struct {
+    unsigned int count;
+    HyperLogLog sites;
+    HyperLogLog hosts;
+    HyperLogLog names;
+    FrequencySketch name_freq;
+    FrequencySketch host_freq;
+    QuantileSketch size;
+    QuantileSketch dependencies;
+} RepositorySketches;
+
+/* Общий массив индексов из кэша запросов */
+typedef struct {
+    volatile long refs;
+    int count;
+    int* indices;
+} CachedIndices;
+
+/* shared != NULL - indices принадлежат кэшу, освобождаются через search_result_free */
+typedef struct {
+    int* indices;
+    int count;
+    CachedIndices* shared;
+} SearchResult;
+
+typedef enum {
+    QUERY_NONE = 0,
+    QUERY_DIRECTION,
+    QUERY_COMBINED,
+    QUERY_RANGE
+} QueryKind;
+
+/* Нормализованные параметры запроса: направление / ГГГГММДД и размер / поле, min, max */
+typedef struct {
+    QueryKind kind;
+    int params[3];
+    unsigned long version;
+    unsigned long last_used;
+    CachedIndices* shared;
+} QueryCacheEntry;
+
+typedef struct {
+    QueryCacheEntry entries[QUERY_CACHE_SIZE];
+    size_t bytes;
+    unsigned long tick;
+    unsigned long hits;
+    unsigned long misses;
+} QueryCache;
+
+/* Неизменяемый кусок записей версии; общий для нескольких версий */
+typedef struct {
+    volatile long refs;
+    int count;
+    Repository records[SNAPSHOT_CHUNK_SIZE];
+    unsigned char dead[SNAPSHOT_CHUNK_SIZE];
+} RecordChunk;
+
+/* Опубликованная версия таблицы: читается без блокировок, живёт до последнего release */
+typedef struct {
+    volatile long refs;
+    unsigned long version;
+    int count;
+    int chunk_count;
+    RecordChunk** chunks;
+} DBSnapshot;
+
+/* Разобранный кусок лениво открытого файла; chunk == -1 - слот свободен */
+typedef struct {
+    int chunk;
+    int count;
+    unsigned long last_used;
+    Repository* records;
+} LazyChunk;
+
+/*
+ * Файл данных, открытый без загрузки: разреженный индекс (смещение первой
+ * записи каждого куска из LAZY_CHUNK_SIZE записей) и кэш разобранных кусков.
+ */
+typedef struct {
+    FILE* file;
+    char filename[MAX_FILENAME];
+    int count;
+    int chunk_count;
+    long long* offsets;
+    LazyChunk cache[LAZY_CACHE_CHUNKS];
+    unsigned long tick;
+    unsigned long hits;
+    unsigned long misses;
+} LazyFile;
+
+/* Запрос K лучших: direction и compatibility равны -1, если фильтра нет */
+typedef struct {
+    NumericField field;
+    int k;
+    int descending;
+    int direction;
+    int compatibility;
+} TopKQuery;
+
+/* Ход сохранения: счётчики пишет поток сохранения, читает интерфейс */
+typedef struct {
+    volatile long written;
+    volatile long total;
+} SaveProgress;
+
+/* Фоновое сохранение опубликованной версии таблицы в отдельном потоке */
+typedef struct {
+    int active;
+    platform_thread thread;
+    DBSnapshot* snapshot;
+    char filename[MAX_FILENAME];
+    SaveProgress progress;
+    volatile long finished;
+    int ok;
+} BackgroundSave;
+
+/*
+ * records изменяет только поток-писатель (загрузка, добавление, сортировка).
+ * Другие потоки читают через db_snapshot_acquire / db_snapshot_release.
+ * dead[i] != 0 - запись удалена (надгробие) и пропускается до уплотнения.
+ */
 typedef struct {
     Repository* records;
+    unsigned char* dead;
     int count;
+    int dead_count;
     int capacity;
+    unsigned long version;
+    int dirty_from;
+    int dirty_to;
+    DBSnapshot* snapshot;
+    platform_mutex snapshot_lock;
+    ZoneMap* zones;
+    int zone_count;
+    int zone_capacity;
+    QueryCache cache;
+    BackgroundSave save;
+    RepositorySketches* sketches;
 } RepositoryDB;
 
+/* Поля, по которым возможна сортировка */
+typedef enum {
+    SORT_NAME = 0,
+    SORT_SITE,
+    SORT_DIRECTION,
+    SORT_SIZE,
+    SORT_DATE,
+    SORT_DEPENDENCIES,
+    SORT_COMPATIBILITY,
+    SORT_FIELD_COUNT
+} SortField;
+
 typedef struct {
-    int* indices;
+    SortField field;
+    int descending;
+} SortKey;
+
+/* Ключи по старшинству: следующий ключ сравнивается при равенстве предыдущих */
+typedef struct {
+    SortKey keys[SORT_MAX_KEYS];
     int count;
-} SearchResult;
+} SortSpec;
+
+/* Какая из записей с одинаковыми названием и сайтом остаётся при объединении */
+typedef enum {
+    MERGE_KEEP_FIRST = 0,   /* первая в порядке слияния */
+    MERGE_NEWEST            /* с более новым релизом */
+} MergePolicy;
+
+typedef struct {
+    int input_records;
+    int duplicates;
+    int replaced;
+    int unsorted_inputs;
+} MergeStats;
+
+/* Записи, прочитанные из файла без БД (импорт и объединение файлов) */
+typedef struct {
+    Repository* records;
+    int count;
+    int capacity;
+} RecordList;
+
+/* Растущий байтовый буфер; offset - начало непрочитанных данных */
+typedef struct {
+    unsigned char* data;
+    size_t length;
+    size_t capacity;
+    size_t offset;
+} Buffer;
 
 extern const char* dir_names[];
 extern const char* compat_names[];
+extern const char* field_names[];
+extern const char* sort_field_keys[];
 
 /* repository_db.c */
 int db_init(RepositoryDB* db);
 int db_free(RepositoryDB* db);
 int db_load_from_file(RepositoryDB* db, const char* filename);
+int read_records_file(const char* filename, RecordList* list);
+int read_text_record(FILE* file, Repository* record, int number);
+const char* validate_repository(const Repository* record);
 int db_save_to_file(RepositoryDB* db, const char* filename);
 int db_add_record(RepositoryDB* db, Repository* record);
+int db_delete_record(RepositoryDB* db, int index);
+int db_update_record(RepositoryDB* db, int index, Repository* record);
+int db_compact(RepositoryDB* db);
+int db_compact_pending(const RepositoryDB* db);
+int db_replace_records(RepositoryDB* db, Repository* records, int count, int capacity,
+                       const ZoneMap* zones, int zone_count, const RepositorySketches* sketches);
 SearchResult db_search_by_direction(RepositoryDB* db, Direction direction);
 SearchResult db_search_combined(RepositoryDB* db, Date target_date, int target_size);
+SearchResult db_search_range(RepositoryDB* db, NumericField field, int min_value, int max_value);
 int search_result_free(SearchResult* result);
+int search_result_append(SearchResult* result, int* capacity, int index);
+int compare_records(const Repository* a, const Repository* b);
 int db_sort_bubble(RepositoryDB* db);
-int db_print_record(Repository* record, int index);
+int db_print_record(const Repository* record, int index);
 int db_print_all(RepositoryDB* db);
+int db_print_stats(RepositoryDB* db);
 const char* direction_to_string(Direction dir);
 const char* compatibility_to_string(Compatibility compat);
 int string_to_direction(const char* str, Direction* result);
@@ -80,6 +358,104 @@ int string_to_compatibility(const char* str, Compatibility* result);
 int validate_date(Date date);
 int compare_dates(Date d1, Date d2);
 
+/* snapshot.c */
+int db_mark_dirty(RepositoryDB* db, int from_index);
+int db_mark_changed(RepositoryDB* db, int index);
+int db_publish(RepositoryDB* db);
+DBSnapshot* db_snapshot_acquire(RepositoryDB* db);
+int db_snapshot_release(DBSnapshot* snapshot);
+const Repository* snapshot_record(const DBSnapshot* snapshot, int index);
+int snapshot_stress_test(int reader_count, int rounds);
+
+/* querycache.c */
+int query_cache_init(QueryCache* cache);
+int query_cache_clear(QueryCache* cache);
+int query_cache_lookup(RepositoryDB* db, QueryKind kind, const int* params, SearchResult* result);
+int query_cache_store(RepositoryDB* db, QueryKind kind, const int* params, SearchResult* result);
+int query_cache_release(CachedIndices* shared);
+
+/* zonemap.c */
+int date_to_key(Date date);
+int record_field_value(const Repository* record, NumericField field);
+int db_zone_include(RepositoryDB* db, int index);
+int db_rebuild_zones(RepositoryDB* db);
+int db_set_zones(RepositoryDB* db, const ZoneMap* zones, int zone_count);
+int zone_build(ZoneMap* zone, const Repository* records, int count);
+int zone_may_contain(const ZoneMap* zone, NumericField field, int min_value, int max_value);
+
+/* lazyfile.c */
+int lazy_init(LazyFile* lazy);
+int lazy_open(LazyFile* lazy, const char* filename);
+int lazy_close(LazyFile* lazy);
+const Repository* lazy_get(LazyFile* lazy, int index);
+SearchResult lazy_search_by_direction(LazyFile* lazy, Direction direction);
+
+/* topk.c */
+SearchResult db_top_k(RepositoryDB* db, const TopKQuery* query);
+SearchResult db_top_k_parallel(RepositoryDB* db, const TopKQuery* query, int thread_count);
+
+/* save.c */
+int snapshot_save_to_file(DBSnapshot* snapshot, const char* filename, SaveProgress* progress);
+int db_save_async(RepositoryDB* db, const char* filename);
+int db_save_poll(RepositoryDB* db);
+int db_save_wait(RepositoryDB* db);
+
+/* sort.c */
+int sort_spec_parse(const char* text, SortSpec* spec);
+int db_sort(RepositoryDB* db, const SortSpec* spec);
+int sort_benchmark(RepositoryDB* db, const SortSpec* spec, int rounds);
+
+/* sketch.c */
+void sketches_reset(RepositorySketches* sketches);
+void sketches_add(RepositorySketches* sketches, const Repository* record);
+void sketches_remove(RepositorySketches* sketches, const Repository* record);
+void sketches_merge(RepositorySketches* dst, const RepositorySketches* src);
+int db_rebuild_sketches(RepositoryDB* db);
+double hll_estimate(const HyperLogLog* hll);
+unsigned int frequency_estimate(const FrequencySketch* freq, const char* value);
+int frequency_top(const FrequencySketch* freq, HeavyHitter* out);
+int quantile_value(const QuantileSketch* q, double fraction);
+unsigned int quantile_count_above(const QuantileSketch* q, int threshold);
+int sketches_encode(Buffer* buf, const RepositorySketches* sketches);
+int sketches_decode(const unsigned char* data, const unsigned char* end, RepositorySketches* sketches);
+int db_print_sketches(RepositoryDB* db, int threshold);
+
+/* merge.c */
+int db_merge_files(RepositoryDB* db, const char* const* filenames, int file_count,
+                   MergePolicy policy, MergeStats* stats);
+
+/* formats.c */
+int db_import_csv(RepositoryDB* db, const char* filename);
+int db_import_jsonl(RepositoryDB* db, const char* filename);
+int read_csv_records(const char* filename, RecordList* list);
+int read_jsonl_records(const char* filename, RecordList* list);
+int snapshot_write_csv(DBSnapshot* snapshot, FILE* file, SaveProgress* progress);
+int snapshot_write_jsonl(DBSnapshot* snapshot, FILE* file, SaveProgress* progress);
+int has_csv_extension(const char* filename);
+int has_jsonl_extension(const char* filename);
+
+/* archive.c */
+int snapshot_write_archive(DBSnapshot* snapshot, FILE* file, SaveProgress* progress);
+int db_load_archive(RepositoryDB* db, const char* filename);
+int read_archive_records(const char* filename, RecordList* list);
+int is_archive_file(const char* filename);
+int has_archive_extension(const char* filename);
+int site_host_length(const char* site);
+unsigned int crc32_compute(const unsigned char* data, size_t size);
+
+/* buffer.c */
+int buffer_reserve(Buffer* buf, size_t extra);
+int buffer_put(Buffer* buf, const void* data, size_t size);
+int buffer_put_varint(Buffer* buf, unsigned long value);
+int buffer_get_varint(const unsigned char** p, const unsigned char* end, unsigned long* value);
+void buffer_compact(Buffer* buf);
+void buffer_free(Buffer* buf);
+unsigned char* read_whole_file(const char* filename, size_t* size);
+
+/* server.c */
+int run_server(const char* socket_path, const char* data_file);
+int run_loadgen(const char* socket_path, int requests, int pipeline);
+
 /* io.c */
 int show_menu();
 int read_int();
@@ -87,6 +463,8 @@ int read_string(char* buffer, int size);
 Date read_date();
 Direction read_direction();
 Compatibility read_compatibility();
+NumericField read_numeric_field();
+int read_filter(const char* title, const char* names[], int count);
 int read_repository_record(Repository* record);
 
 #endif
@@ -1,12 +1,13 @@
 /**
  * @file repository_db.c
- * @brief   
- * @author   
+ * @brief База данных репозитория
+ * @author Костопраев Дмитрий Евгеньевич
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include "repository.h"
 
 const char* dir_names[] = {
@@ -20,18 +21,60 @@ const char* compat_names[] = {
 int db_init(RepositoryDB* db)
 {
     if (db == NULL) {
-        fprintf(stderr, ":  NULL-  db_init\n");
+        fprintf(stderr, "Ошибка: передан NULL-указатель в db_init\n");
         return 0;
     }
     
     db->records = (Repository*)malloc(INITIAL_CAPACITY * sizeof(Repository));
-    if (db->records == NULL) {
-        fprintf(stderr, "     \n");
+    db->dead = (unsigned char*)calloc(INITIAL_CAPACITY, 1);
+    db->sketches = (RepositorySketches*)calloc(1, sizeof(RepositorySketches));
+    if (db->records == NULL || db->dead == NULL || db->sketches == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти при инициализации БД\n");
+        free(db->records);
+        free(db->dead);
+        free(db->sketches);
+        db->records = NULL;
+        db->dead = NULL;
+        db->sketches = NULL;
         return 0;
     }
     
     db->count = 0;
     db->capacity = INITIAL_CAPACITY;
+    db->dead_count = 0;
+    db->version = 0;
+    db->dirty_from = INT_MAX;
+    db->dirty_to = 0;
+    db->snapshot = NULL;
+    db->zones = NULL;
+    db->zone_count = 0;
+    db->zone_capacity = 0;
+    query_cache_init(&db->cache);
+    db->save.active = 0;
+    db->save.snapshot = NULL;
+    
+    if (!platform_mutex_init(&db->snapshot_lock)) {
+        fprintf(stderr, "Ошибка инициализации блокировки БД\n");
+        free(db->records);
+        free(db->dead);
+        free(db->sketches);
+        db->records = NULL;
+        db->dead = NULL;
+        db->sketches = NULL;
+        return 0;
+    }
+    
+    if (!db_publish(db)) {
+        platform_mutex_destroy(&db->snapshot_lock);
+        free(db->records);
+        free(db->dead);
+        free(db->sketches);
+        db->records = NULL;
+        db->dead = NULL;
+        db->sketches = NULL;
+        return 0;
+    }
+    
     return 1;
 }
 
@@ -41,13 +84,33 @@ int db_free(RepositoryDB* db)
         return 0;
     }
     
+    db_save_wait(db);
+    
     if (db->records != NULL) {
         free(db->records);
         db->records = NULL;
     }
     
+    free(db->dead);
+    db->dead = NULL;
+    db->dead_count = 0;
     db->count = 0;
     db->capacity = 0;
+    
+    query_cache_clear(&db->cache);
+    free(db->zones);
+    db->zones = NULL;
+    db->zone_count = 0;
+    db->zone_capacity = 0;
+    free(db->sketches);
+    db->sketches = NULL;
+    
+    /* Читатели, ещё держащие версию, освободят её сами */
+    if (db->snapshot != NULL) {
+        db_snapshot_release(db->snapshot);
+        db->snapshot = NULL;
+    }
+    platform_mutex_destroy(&db->snapshot_lock);
     return 1;
 }
 
@@ -82,7 +145,7 @@ int string_to_direction(const char* str, Direction* result)
         }
     }
     
-    fprintf(stderr, ":   '%s'\n", str);
+    fprintf(stderr, "Ошибка: неизвестное направление '%s'\n", str);
     return 0;
 }
 
@@ -101,7 +164,7 @@ int string_to_compatibility(const char* str, Compatibility* result)
         }
     }
     
-    fprintf(stderr, ":   '%s'\n", str);
+    fprintf(stderr, "Ошибка: неизвестная совместимость '%s'\n", str);
     return 0;
 }
 
@@ -141,263 +204,658 @@ int compare_dates(Date d1, Date d2)
 static int db_grow_capacity(RepositoryDB* db)
 {
     int new_capacity;
-    Repository* temp;
+    Repository* temp;    
+    unsigned char* dead;
     
     new_capacity = db->capacity * 2;
     temp = (Repository*)realloc(db->records, new_capacity * sizeof(Repository));
     
     if (temp == NULL) {
-        fprintf(stderr, "     \n");
+        fprintf(stderr, "Ошибка выделения памяти при расширении БД\n");
         return 0;
     }
-    
     db->records = temp;
+    
+    dead = (unsigned char*)realloc(db->dead, new_capacity);
+    if (dead == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти при расширении БД\n");
+        return 0;
+    }
+    db->dead = dead;
+    
     db->capacity = new_capacity;
     return 1;
 }
 
-int db_load_from_file(RepositoryDB* db, const char* filename)
+/* Очистить записи писателя, не трогая опубликованную версию и блокировку */
+static int db_clear_records(RepositoryDB* db)
+{
+    Repository* temp;
+    unsigned char* dead;
+    
+    if (db->capacity != INITIAL_CAPACITY) {
+        temp = (Repository*)realloc(db->records, INITIAL_CAPACITY * sizeof(Repository));
+        dead = (unsigned char*)realloc(db->dead, INITIAL_CAPACITY);
+        if (temp == NULL || dead == NULL) {
+            fprintf(stderr, "Ошибка выделения памяти при очистке БД\n");
+            return 0;
+        }
+        db->records = temp;
+        db->dead = dead;
+        db->capacity = INITIAL_CAPACITY;
+    }
+    
+    db->count = 0;
+    db->dead_count = 0;
+    db->zone_count = 0;
+    sketches_reset(db->sketches);
+    db_mark_dirty(db, 0);
+    return 1;
+}
+
+/* Добавление без публикации версии: для массовой загрузки */
+static int db_append_record(RepositoryDB* db, Repository* record)
+{
+    if (db->count >= db->capacity) {
+        if (!db_grow_capacity(db)) {
+            return 0;
+        }
+    }
+    
+    db->records[db->count] = *record;
+    db->dead[db->count] = 0;
+    if (!db_zone_include(db, db->count)) {
+        return 0;
+    }
+    sketches_add(db->sketches, record);
+    db_mark_dirty(db, db->count);
+    db->count++;
+    return 1;
+}
+
+/*
+ * Заменить записи готовым массивом и опубликовать версию. Владение массивом
+ * переходит к функции в любом случае, вызывающий его не освобождает: при
+ * ошибке до замены массив освобождается и БД не меняется, а если после
+ * замены не хватило памяти для зон или версии, записи остаются в БД, но
+ * версия не опубликована. Готовые зоны (zones != NULL) принимаются, если их
+ * число соответствует count; готовые скетчи (sketches != NULL) - если они
+ * построены по тем же записям.
+ */
+int db_replace_records(RepositoryDB* db, Repository* records, int count, int capacity,
+                       const ZoneMap* zones, int zone_count, const RepositorySketches* sketches)
+{
+    unsigned char* dead;
+    
+    if (db == NULL || records == NULL || count < 0 || capacity < count || capacity <= 0) {
+        fprintf(stderr, "Ошибка: некорректные параметры в db_replace_records\n");
+        free(records);
+        return 0;
+    }
+    
+    dead = (unsigned char*)calloc(capacity, 1);
+    if (dead == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для замены записей\n");
+        free(records);
+        return 0;
+    }
+    
+    free(db->records);
+    free(db->dead);
+    db->records = records;
+    db->dead = dead;
+    db->dead_count = 0;
+    db->count = count;
+    db->capacity = capacity;
+    db_mark_dirty(db, 0);
+    
+    if ((zones == NULL || !db_set_zones(db, zones, zone_count)) && !db_rebuild_zones(db)) {
+        return 0;
+    }
+    
+    if (sketches == NULL || sketches->count != (unsigned int)count) {
+        db_rebuild_sketches(db);
+    } else if (sketches != db->sketches) {
+        *db->sketches = *sketches;
+    }
+    
+    return db_publish(db);
+}
+
+/* Перевод строки в сайте или названии сломал бы построчный текстовый формат */
+static int has_control_chars(const char* str)
+{
+    for (; *str != '\0'; str++) {
+        if ((unsigned char)*str < 0x20 || *str == 0x7F) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Проверка полей записи: NULL, если запись корректна, иначе описание ошибки */
+const char* validate_repository(const Repository* record)
+{
+    if (record->size <= 0) {
+        return "размер должен быть > 0";
+    }
+    
+    if (record->dependencies < 0) {
+        return "зависимости должны быть >= 0";
+    }
+    
+    if (!validate_date(record->release_date)) {
+        return "некорректная дата";
+    }
+    
+    if (has_control_chars(record->site) || has_control_chars(record->name)) {
+        return "управляющие символы в сайте или названии недопустимы";
+    }
+    
+    return NULL;
+}
+
+/*
+ * Прочитать одну запись текстового формата. Возвращает 1 - запись прочитана,
+ * 0 - данных больше нет, -1 - запись number некорректна (сообщение выведено).
+ * Строки могут заканчиваться и CRLF: файл, открытый в двоичном режиме
+ * (ленивое открытие), читается так же, как в текстовом.
+ */
+int read_text_record(FILE* file, Repository* record, int number)
 {
-    FILE* file;
     int read_count;
-    int line_number = 0;
     char dir_str[MAX_STR];
     char compat_str[MAX_STR];
+    const char* message;
+    
+    read_count = fscanf(file, "%49[^\r\n]\n%99[^\r\n]\n%99[^\r\n]\n%d\n%d %d %d\n%d\n%49[^\r\n]\n",
+        dir_str, record->site, record->name, &record->size,
+        &record->release_date.day, &record->release_date.month, 
+        &record->release_date.year, &record->dependencies, compat_str);
+    
+    if (read_count != 9) {
+        return 0;
+    }
+    
+    if (!string_to_direction(dir_str, &record->direction)) {
+        fprintf(stderr, "Ошибка в записи %d: некорректное направление\n", number);
+        return -1;
+    }
+    
+    if (!string_to_compatibility(compat_str, &record->compatibility)) {
+        fprintf(stderr, "Ошибка в записи %d: некорректная совместимость\n", number);
+        return -1;
+    }
+    
+    message = validate_repository(record);
+    if (message != NULL) {
+        fprintf(stderr, "Ошибка в записи %d: %s\n", number, message);
+        return -1;
+    }
+    
+    return 1;
+}
+
+int db_load_from_file(RepositoryDB* db, const char* filename)
+{
+    FILE* file;
+    int status;
+    int line_number = 0;
     Repository current;
     
     if (db == NULL || filename == NULL) {
-        fprintf(stderr, ":    db_load_from_file\n");
+        fprintf(stderr, "Ошибка: некорректные параметры в db_load_from_file\n");
         return 0;
     }
     
+    if (is_archive_file(filename)) {
+        return db_load_archive(db, filename);
+    }
+    if (has_csv_extension(filename)) {
+        return db_import_csv(db, filename);
+    }
+    if (has_jsonl_extension(filename)) {
+        return db_import_jsonl(db, filename);
+    }
+    
     file = fopen(filename, "r");
     if (file == NULL) {
-        perror("  ");
+        perror("Ошибка открытия файла");
         return 0;
     }
     
-    db_free(db);
-    if (!db_init(db)) {
+    if (!db_clear_records(db)) {
         fclose(file);
         return 0;
     }
     
-    while (1) {
-        read_count = fscanf(file, "%49[^\n]\n%99[^\n]\n%99[^\n]\n%d\n%d %d %d\n%d\n%49[^\n]\n",
-            dir_str, current.site, current.name, &current.size,
-            &current.release_date.day, &current.release_date.month, 
-            &current.release_date.year, &current.dependencies, compat_str);
-        
-        if (read_count != 9) {
+    while ((status = read_text_record(file, &current, ++line_number)) == 1) {
+        if (!db_append_record(db, &current)) {
+            status = -1;
             break;
         }
-        
-        line_number++;
-        
-        if (!string_to_direction(dir_str, &current.direction)) {
-            fprintf(stderr, "   %d:  \n", line_number);
-            fclose(file);
-            db_free(db);
-            return 0;
-        }
-        
-        if (!string_to_compatibility(compat_str, &current.compatibility)) {
-            fprintf(stderr, "   %d:  \n", line_number);
-            fclose(file);
-            db_free(db);
-            return 0;
-        }
-        
-        if (current.size <= 0) {
-            fprintf(stderr, "   %d:    > 0\n", line_number);
-            fclose(file);
-            db_free(db);
-            return 0;
-        }
-        
-        if (current.dependencies < 0) {
-            fprintf(stderr, "   %d:    >= 0\n", line_number);
-            fclose(file);
-            db_free(db);
-            return 0;
-        }
-        
-        if (!validate_date(current.release_date)) {
-            fprintf(stderr, "   %d:  \n", line_number);
-            fclose(file);
-            db_free(db);
-            return 0;
-        }
-        
-        if (!db_add_record(db, &current)) {
-            fclose(file);
-            db_free(db);
-            return 0;
-        }
     }
     
     fclose(file);
     
+    if (status < 0) {
+        db_clear_records(db);
+        db_publish(db);
+        return 0;
+    }
+    
     if (db->count == 0) {
-        fprintf(stderr, "     \n");
-        db_free(db);
+        fprintf(stderr, "Файл пуст или имеет неверный формат\n");
+        db_publish(db);
         return 0;
     }
     
-    return 1;
+    return db_publish(db);
 }
 
-int db_save_to_file(RepositoryDB* db, const char* filename)
+/*
+ * Прочитать записи файла любого формата в list без БД и без дополнительных
+ * потоков (используется при объединении файлов, которые и так разбираются
+ * параллельно). При ошибке или пустом файле list пуст.
+ */
+int read_records_file(const char* filename, RecordList* list)
 {
     FILE* file;
-    int i;
+    Repository* temp;
+    int status;
+    int line_number = 0;
+    int new_capacity;
     
-    if (db == NULL || filename == NULL) {
-        fprintf(stderr, ":    db_save_to_file\n");
+    if (filename == NULL || list == NULL) {
+        fprintf(stderr, "Ошибка: некорректные параметры в read_records_file\n");
         return 0;
     }
     
-    if (db->count == 0) {
-        fprintf(stderr, "   \n");
-        return 0;
+    list->records = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    
+    if (is_archive_file(filename)) {
+        return read_archive_records(filename, list);
+    }
+    if (has_csv_extension(filename)) {
+        return read_csv_records(filename, list);
+    }
+    if (has_jsonl_extension(filename)) {
+        return read_jsonl_records(filename, list);
     }
     
-    file = fopen(filename, "w");
+    file = fopen(filename, "r");
     if (file == NULL) {
-        perror("  ");
+        perror("Ошибка открытия файла");
         return 0;
     }
     
-    for (i = 0; i < db->count; i++) {
-        fprintf(file, "%s\n%s\n%s\n%d\n%d %d %d\n%d\n%s\n",
-            direction_to_string(db->records[i].direction),
-            db->records[i].site,
-            db->records[i].name,
-            db->records[i].size,
-            db->records[i].release_date.day,
-            db->records[i].release_date.month,
-            db->records[i].release_date.year,
-            db->records[i].dependencies,
-            compatibility_to_string(db->records[i].compatibility));
+    while (1) {
+        if (list->count >= list->capacity) {
+            new_capacity = list->capacity > 0 ? list->capacity * 2 : INITIAL_CAPACITY;
+            temp = (Repository*)realloc(list->records, new_capacity * sizeof(Repository));
+            if (temp == NULL) {
+                fprintf(stderr, "Ошибка выделения памяти при загрузке\n");
+                status = -1;
+                break;
+            }
+            list->records = temp;
+            list->capacity = new_capacity;
+        }
+        
+        status = read_text_record(file, &list->records[list->count], ++line_number);
+        if (status != 1) {
+            break;
+        }
+        list->count++;
     }
     
     fclose(file);
+    
+    if (status == 0 && list->count == 0) {
+        fprintf(stderr, "Файл пуст или имеет неверный формат\n");
+    }
+    if (status < 0 || list->count == 0) {
+        free(list->records);
+        list->records = NULL;
+        list->count = 0;
+        list->capacity = 0;
+        return 0;
+    }
     return 1;
 }
 
+/*
+ * Синхронное сохранение текущей версии; файл заменяется атомарно (см. save.c).
+ * Фоновое сохранение в тот же файл сначала дожидается завершения: иначе оба
+ * писали бы один временный файл.
+ */
+int db_save_to_file(RepositoryDB* db, const char* filename)
+{
+    DBSnapshot* snapshot;
+    int ok;
+    
+    if (db == NULL || filename == NULL) {
+        fprintf(stderr, "Ошибка: некорректные параметры в db_save_to_file\n");
+        return 0;
+    }
+    
+    if (db->save.active && strcmp(db->save.filename, filename) == 0 && !db_save_wait(db)) {
+        fprintf(stderr, "Фоновое сохранение в '%s' не выполнено\n", filename);
+    }
+    
+    if (db->count - db->dead_count == 0) {
+        fprintf(stderr, "Нет данных для сохранения\n");
+        return 0;
+    }
+    
+    snapshot = db_snapshot_acquire(db);
+    ok = snapshot_save_to_file(snapshot, filename, NULL);
+    db_snapshot_release(snapshot);
+    return ok;
+}
+
 int db_add_record(RepositoryDB* db, Repository* record)
 {
+    const char* error;
+    
     if (db == NULL || record == NULL) {
-        fprintf(stderr, ":    db_add_record\n");
+        fprintf(stderr, "Ошибка: некорректные параметры в db_add_record\n");
         return 0;
     }
     
-    if (db->count >= db->capacity) {
-        if (!db_grow_capacity(db)) {
-            return 0;
-        }
+    error = validate_repository(record);
+    if (error != NULL) {
+        fprintf(stderr, "Ошибка: %s\n", error);
+        return 0;
+    }
+    
+    if (!db_append_record(db, record)) {
+        return 0;
+    }
+    
+    return db_publish(db);
+}
+
+static int db_check_slot(RepositoryDB* db, int index, const char* func)
+{
+    if (db == NULL || index < 0 || index >= db->count) {
+        fprintf(stderr, "Ошибка: некорректный номер записи в %s\n", func);
+        return 0;
+    }
+    
+    if (db->dead[index]) {
+        fprintf(stderr, "Ошибка: запись %d уже удалена\n", index + 1);
+        return 0;
     }
     
-    db->records[db->count] = *record;
-    db->count++;
     return 1;
 }
 
+/*
+ * Удаление помечает ячейку надгробием за O(1), записи не сдвигаются,
+ * поэтому номера остальных записей остаются прежними. Уплотнение
+ * выполняет вызывающий, когда db_compact_pending и номера уже не нужны.
+ */
+int db_delete_record(RepositoryDB* db, int index)
+{
+    if (!db_check_slot(db, index, "db_delete_record")) {
+        return 0;
+    }
+    
+    sketches_remove(db->sketches, &db->records[index]);
+    db->dead[index] = 1;
+    db->dead_count++;
+    db_mark_changed(db, index);
+    
+    return db_publish(db);
+}
+
+/* Доля надгробий превысила COMPACT_THRESHOLD_PERCENT */
+int db_compact_pending(const RepositoryDB* db)
+{
+    return db != NULL && db->dead_count > 0 &&
+           (long long)db->dead_count * 100 > (long long)db->count * COMPACT_THRESHOLD_PERCENT;
+}
+
+/* Замена записи на месте; зона блока только расширяется, поэтому остаётся верной */
+int db_update_record(RepositoryDB* db, int index, Repository* record)
+{
+    const char* error;
+    
+    if (record == NULL || !db_check_slot(db, index, "db_update_record")) {
+        return 0;
+    }
+    
+    error = validate_repository(record);
+    if (error != NULL) {
+        fprintf(stderr, "Ошибка: %s\n", error);
+        return 0;
+    }
+    
+    sketches_remove(db->sketches, &db->records[index]);
+    db->records[index] = *record;
+    if (!db_zone_include(db, index)) {
+        return 0;
+    }
+    sketches_add(db->sketches, record);
+    db_mark_changed(db, index);
+    
+    return db_publish(db);
+}
+
+/*
+ * Уплотнение: живые записи сдвигаются к началу с сохранением порядка.
+ * Куски версии до первого надгробия переходят в новую версию без копирования.
+ */
+int db_compact(RepositoryDB* db)
+{
+    int first_dead;
+    int src, dst;
+    
+    if (db == NULL) {
+        fprintf(stderr, "Ошибка: некорректный параметр в db_compact\n");
+        return 0;
+    }
+    
+    if (db->dead_count == 0) {
+        return 1;
+    }
+    
+    for (first_dead = 0; first_dead < db->count && !db->dead[first_dead]; first_dead++) {
+    }
+    
+    dst = first_dead;
+    for (src = first_dead; src < db->count; src++) {
+        if (!db->dead[src]) {
+            db->records[dst] = db->records[src];
+            db->dead[dst] = 0;
+            dst++;
+        }
+    }
+    
+    db->count = dst;
+    db->dead_count = 0;
+    db_mark_dirty(db, first_dead);
+    
+    if (!db_rebuild_zones(db) || !db_rebuild_sketches(db)) {
+        return 0;
+    }
+    return db_publish(db);
+}
+
 int search_result_free(SearchResult* result)
 {
     if (result == NULL) {
         return 0;
     }
     
-    if (result->indices != NULL) {
+    if (result->shared != NULL) {
+        query_cache_release(result->shared);
+        result->shared = NULL;
+    } else if (result->indices != NULL) {
         free(result->indices);
-        result->indices = NULL;
     }
+    result->indices = NULL;
     result->count = 0;
     return 1;
 }
 
+/* Добавить индекс в результат, удваивая буфер; при ошибке результат очищается */
+int search_result_append(SearchResult* result, int* capacity, int index)
+{
+    int* temp;
+    
+    if (result->count >= *capacity) {
+        *capacity = (*capacity > 0) ? *capacity * 2 : INITIAL_CAPACITY;
+        temp = (int*)realloc(result->indices, *capacity * sizeof(int));
+        if (temp == NULL) {
+            fprintf(stderr, "Ошибка расширения результата поиска\n");
+            search_result_free(result);
+            *capacity = 0;
+            return 0;
+        }
+        result->indices = temp;
+    }
+    
+    result->indices[result->count] = index;
+    result->count++;
+    return 1;
+}
+
 SearchResult db_search_by_direction(RepositoryDB* db, Direction direction)
 {
-    SearchResult result = { NULL, 0 };
-    int i;
+    SearchResult result = { NULL, 0, NULL };
+    int i, z;
+    int end;
     int capacity = INITIAL_CAPACITY;
-    int* temp;
+    int params[3] = { 0, 0, 0 };
     
     if (db == NULL || db->count == 0) {
         return result;
     }
     
+    params[0] = direction;
+    if (query_cache_lookup(db, QUERY_DIRECTION, params, &result)) {
+        return result;
+    }
+    
     result.indices = (int*)malloc(capacity * sizeof(int));
     if (result.indices == NULL) {
-        fprintf(stderr, "     \n");
+        fprintf(stderr, "Ошибка выделения памяти для результата поиска\n");
         return result;
     }
     
-    for (i = 0; i < db->count; i++) {
-        if (db->records[i].direction == direction) {
-            if (result.count >= capacity) {
-                capacity *= 2;
-                temp = (int*)realloc(result.indices, capacity * sizeof(int));
-                if (temp == NULL) {
-                    fprintf(stderr, "   \n");
-                    free(result.indices);
-                    result.indices = NULL;
-                    result.count = 0;
-                    return result;
-                }
-                result.indices = temp;
+    for (z = 0; z < db->zone_count; z++) {
+        if (!(db->zones[z].direction_mask & (1 << direction))) {
+            continue;
+        }
+        
+        end = (z + 1) * ZONE_BLOCK_SIZE < db->count ? (z + 1) * ZONE_BLOCK_SIZE : db->count;
+        for (i = z * ZONE_BLOCK_SIZE; i < end; i++) {
+            if (!db->dead[i] && db->records[i].direction == direction &&
+                !search_result_append(&result, &capacity, i)) {
+                return result;
             }
-            result.indices[result.count] = i;
-            result.count++;
         }
     }
     
+    query_cache_store(db, QUERY_DIRECTION, params, &result);
     return result;
 }
 
-/*  :   == target_date   == target_size */
+/* Комбинированный поиск: дата релиза == target_date И размер == target_size */
 SearchResult db_search_combined(RepositoryDB* db, Date target_date, int target_size)
 {
-    SearchResult result = { NULL, 0 };
-    int i;
+    SearchResult result = { NULL, 0, NULL };
+    int i, z;
+    int end;
     int capacity = INITIAL_CAPACITY;
-    int* temp;
+    int params[3] = { 0, 0, 0 };
     
     if (db == NULL || db->count == 0) {
         return result;
     }
     
+    params[0] = date_to_key(target_date);
+    params[1] = target_size;
+    if (query_cache_lookup(db, QUERY_COMBINED, params, &result)) {
+        return result;
+    }
+    
     result.indices = (int*)malloc(capacity * sizeof(int));
     if (result.indices == NULL) {
-        fprintf(stderr, "     \n");
+        fprintf(stderr, "Ошибка выделения памяти для результата поиска\n");
         return result;
     }
     
-    for (i = 0; i < db->count; i++) {
-        if (compare_dates(db->records[i].release_date, target_date) == 0 &&
-            db->records[i].size == target_size) {
-            if (result.count >= capacity) {
-                capacity *= 2;
-                temp = (int*)realloc(result.indices, capacity * sizeof(int));
-                if (temp == NULL) {
-                    fprintf(stderr, "   \n");
-                    free(result.indices);
-                    result.indices = NULL;
-                    result.count = 0;
-                    return result;
-                }
-                result.indices = temp;
+    for (z = 0; z < db->zone_count; z++) {
+        if (!zone_may_contain(&db->zones[z], FIELD_SIZE, target_size, target_size) ||
+            !zone_may_contain(&db->zones[z], FIELD_RELEASE_DATE,
+                              date_to_key(target_date), date_to_key(target_date))) {
+            continue;
+        }
+        
+        end = (z + 1) * ZONE_BLOCK_SIZE < db->count ? (z + 1) * ZONE_BLOCK_SIZE : db->count;
+        for (i = z * ZONE_BLOCK_SIZE; i < end; i++) {
+            if (!db->dead[i] && compare_dates(db->records[i].release_date, target_date) == 0 &&
+                db->records[i].size == target_size &&
+                !search_result_append(&result, &capacity, i)) {
+                return result;
             }
-            result.indices[result.count] = i;
-            result.count++;
         }
     }
     
+    query_cache_store(db, QUERY_COMBINED, params, &result);
     return result;
 }
 
-static int compare_records(Repository* a, Repository* b)
+/* Поиск по диапазону: min_value <= поле <= max_value (дата - в виде ГГГГММДД) */
+SearchResult db_search_range(RepositoryDB* db, NumericField field, int min_value, int max_value)
+{
+    SearchResult result = { NULL, 0, NULL };
+    int i, z;
+    int end;
+    int value;
+    int capacity = 0;
+    int params[3];
+    
+    if (db == NULL || db->count == 0 || field < 0 || field >= FIELD_COUNT) {
+        return result;
+    }
+    
+    params[0] = field;
+    params[1] = min_value;
+    params[2] = max_value;
+    if (query_cache_lookup(db, QUERY_RANGE, params, &result)) {
+        return result;
+    }
+    
+    for (z = 0; z < db->zone_count; z++) {
+        if (!zone_may_contain(&db->zones[z], field, min_value, max_value)) {
+            continue;
+        }
+        
+        end = (z + 1) * ZONE_BLOCK_SIZE < db->count ? (z + 1) * ZONE_BLOCK_SIZE : db->count;
+        for (i = z * ZONE_BLOCK_SIZE; i < end; i++) {
+            if (db->dead[i]) {
+                continue;
+            }
+            value = record_field_value(&db->records[i], field);
+            if (value >= min_value && value <= max_value &&
+                !search_result_append(&result, &capacity, i)) {
+                return result;
+            }
+        }
+    }
+    
+    query_cache_store(db, QUERY_RANGE, params, &result);
+    return result;
+}
+
+/* Порядок сортировки: Название (возр.) -> Направление (возр.) -> Дата релиза (убыв.) */
+int compare_records(const Repository* a, const Repository* b)
 {
     int cmp_name;
     int cmp_date;
@@ -415,7 +873,7 @@ static int compare_records(Repository* a, Repository* b)
     return -cmp_date;
 }
 
-/*  :  (.) ->  (.) ->   (.) */
+/* Пузырьковая сортировка: Название (возр.) -> Направление (возр.) -> Дата релиза (убыв.) */
 int db_sort_bubble(RepositoryDB* db)
 {
     int i, j;
@@ -423,7 +881,11 @@ int db_sort_bubble(RepositoryDB* db)
     Repository temp;
     
     if (db == NULL) {
-        fprintf(stderr, ":    db_sort_bubble\n");
+        fprintf(stderr, "Ошибка: некорректный параметр в db_sort_bubble\n");
+        return 0;
+    }
+    
+    if (db->dead_count > 0 && !db_compact(db)) {
         return 0;
     }
     
@@ -448,20 +910,24 @@ int db_sort_bubble(RepositoryDB* db)
         }
     }
     
-    return 1;
+    db_mark_dirty(db, 0);
+    if (!db_rebuild_zones(db)) {
+        return 0;
+    }
+    return db_publish(db);
 }
 
-int db_print_record(Repository* record, int index)
+int db_print_record(const Repository* record, int index)
 {
     if (record == NULL) {
-        fprintf(stderr, ":    db_print_record\n");
+        fprintf(stderr, "Ошибка: некорректный параметр в db_print_record\n");
         return 0;
     }
     
-    printf("\n---  %d ---\n", index);
-    printf(": %s\n: %s\n: %s\n: %d \n",
+    printf("\n--- Запись %d ---\n", index);
+    printf("Направление: %s\nСайт: %s\nНазвание: %s\nРазмер: %d Кб\n",
         direction_to_string(record->direction), record->site, record->name, record->size);
-    printf(" : %02d.%02d.%04d\n: %d\n: %s\n",
+    printf("Дата релиза: %02d.%02d.%04d\nЗависимости: %d\nСовместимость: %s\n",
         record->release_date.day, record->release_date.month, record->release_date.year,
         record->dependencies, compatibility_to_string(record->compatibility));
     
@@ -473,20 +939,48 @@ int db_print_all(RepositoryDB* db)
     int i;
     
     if (db == NULL) {
-        fprintf(stderr, ":    db_print_all\n");
+        fprintf(stderr, "Ошибка: некорректный параметр в db_print_all\n");
         return 0;
     }
     
-    if (db->count == 0) {
-        printf("\n  .\n");
+    if (db->count - db->dead_count == 0) {
+        printf("\nБаза данных пуста.\n");
         return 1;
     }
     
-    printf("\n===    (%d) ===\n", db->count);
+    printf("\n=== Список всех записей (%d) ===\n", db->count - db->dead_count);
     
     for (i = 0; i < db->count; i++) {
-        db_print_record(&db->records[i], i + 1);
+        if (!db->dead[i]) {
+            db_print_record(&db->records[i], i + 1);
+        }
+    }
+    
+    return 1;
+}
+
+int db_print_stats(RepositoryDB* db)
+{
+    unsigned long lookups;
+    
+    if (db == NULL) {
+        fprintf(stderr, "Ошибка: некорректный параметр в db_print_stats\n");
+        return 0;
+    }
+    
+    lookups = db->cache.hits + db->cache.misses;
+    
+    printf("\n=== Статистика ===\n");
+    printf("Записей: %d (удалённых ячеек: %d, выделено: %d)\n",
+        db->count - db->dead_count, db->dead_count, db->capacity);
+    printf("Блоков зон: %d по %d записей\n", db->zone_count, ZONE_BLOCK_SIZE);
+    printf("Версия данных: %lu\n", db->version);
+    printf("Кэш запросов: попаданий %lu, промахов %lu", db->cache.hits, db->cache.misses);
+    if (lookups > 0) {
+        printf(" (%.1f%%)", 100.0 * db->cache.hits / lookups);
     }
+    printf(", занято %lu Кб из %lu Кб\n", (unsigned long)(db->cache.bytes / 1024),
+        (unsigned long)(QUERY_CACHE_BYTES / 1024));
     
     return 1;
 }
@@ -0,0 +1,212 @@
+/**
+ * @file save.c
+ * @brief База данных репозитория - атомарное и фоновое сохранение
+ * @author Костопраев Дмитрий Евгеньевич
+ *
+ * Сохраняется опубликованная версия таблицы, поэтому писатель может менять
+ * базу во время записи. Данные пишутся во временный файл рядом с целевым
+ * через большой буфер, сбрасываются на диск и переименовываются поверх
+ * целевого файла: при сбое на диске остаётся прежний файл целиком.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "repository.h"
+
+#define TEMP_SUFFIX ".tmp"
+
+static int write_text(DBSnapshot* snapshot, FILE* file, SaveProgress* progress)
+{
+    RecordChunk* chunk;
+    Repository* record;
+    int c, i;
+    
+    for (c = 0; c < snapshot->chunk_count; c++) {
+        chunk = snapshot->chunks[c];
+        for (i = 0; i < chunk->count; i++) {
+            if (chunk->dead[i]) {
+                continue;
+            }
+            record = &chunk->records[i];
+            if (fprintf(file, "%s\n%s\n%s\n%d\n%d %d %d\n%d\n%s\n",
+                    direction_to_string(record->direction),
+                    record->site,
+                    record->name,
+                    record->size,
+                    record->release_date.day,
+                    record->release_date.month,
+                    record->release_date.year,
+                    record->dependencies,
+                    compatibility_to_string(record->compatibility)) < 0) {
+                fprintf(stderr, "Ошибка записи в файл\n");
+                return 0;
+            }
+        }
+        
+        if (progress != NULL) {
+            progress->written += chunk->count;
+        }
+    }
+    
+    return 1;
+}
+
+/* Записать версию в filename через временный файл; формат выбирается по расширению */
+int snapshot_save_to_file(DBSnapshot* snapshot, const char* filename, SaveProgress* progress)
+{
+    char temp_name[MAX_FILENAME + sizeof(TEMP_SUFFIX)];
+    FILE* file;
+    int archive;
+    int ok;
+    
+    if (snapshot == NULL || filename == NULL || strlen(filename) >= MAX_FILENAME) {
+        fprintf(stderr, "Ошибка: некорректные параметры в snapshot_save_to_file\n");
+        return 0;
+    }
+    
+    if (progress != NULL) {
+        progress->written = 0;
+        progress->total = snapshot->count;
+    }
+    
+    archive = has_archive_extension(filename);
+    sprintf(temp_name, "%s%s", filename, TEMP_SUFFIX);
+    
+    file = fopen(temp_name, archive ? "wb" : "w");
+    if (file == NULL) {
+        perror("Ошибка создания файла");
+        return 0;
+    }
+    setvbuf(file, NULL, _IOFBF, SAVE_BUFFER_SIZE);
+    
+    if (archive) {
+        ok = snapshot_write_archive(snapshot, file, progress);
+    } else if (has_csv_extension(filename)) {
+        ok = snapshot_write_csv(snapshot, file, progress);
+    } else if (has_jsonl_extension(filename)) {
+        ok = snapshot_write_jsonl(snapshot, file, progress);
+    } else {
+        ok = write_text(snapshot, file, progress);
+    }
+    
+    if (ok && !platform_file_sync(file)) {
+        perror("Ошибка сброса файла на диск");
+        ok = 0;
+    }
+    if (fclose(file) != 0 && ok) {
+        perror("Ошибка закрытия файла");
+        ok = 0;
+    }
+    
+    if (ok && !platform_replace_file(temp_name, filename)) {
+        ok = 0;
+    }
+    if (!ok) {
+        remove(temp_name);
+    }
+    
+    return ok;
+}
+
+static int save_thread(void* arg)
+{
+    BackgroundSave* save = (BackgroundSave*)arg;
+    
+    save->ok = snapshot_save_to_file(save->snapshot, save->filename, &save->progress);
+    platform_atomic_inc(&save->finished);
+    return save->ok;
+}
+
+/* Завершить поток сохранения и освободить его версию таблицы */
+static int save_reap(RepositoryDB* db)
+{
+    platform_thread_join(db->save.thread);
+    db_snapshot_release(db->save.snapshot);
+    db->save.snapshot = NULL;
+    db->save.active = 0;
+    return db->save.ok;
+}
+
+/*
+ * Запустить сохранение текущей версии в отдельном потоке.
+ * Одновременно выполняется не больше одного фонового сохранения.
+ */
+int db_save_async(RepositoryDB* db, const char* filename)
+{
+    if (db == NULL || filename == NULL || strlen(filename) >= MAX_FILENAME) {
+        fprintf(stderr, "Ошибка: некорректные параметры в db_save_async\n");
+        return 0;
+    }
+    
+    if (db->save.active) {
+        fprintf(stderr, "Предыдущее сохранение в '%s' ещё выполняется\n", db->save.filename);
+        return 0;
+    }
+    
+    if (db->count - db->dead_count == 0) {
+        fprintf(stderr, "Нет данных для сохранения\n");
+        return 0;
+    }
+    
+    db->save.snapshot = db_snapshot_acquire(db);
+    if (db->save.snapshot == NULL) {
+        return 0;
+    }
+    
+    strcpy(db->save.filename, filename);
+    db->save.progress.written = 0;
+    db->save.progress.total = db->save.snapshot->count;
+    db->save.finished = 0;
+    db->save.ok = 0;
+    
+    if (!platform_thread_create(&db->save.thread, save_thread, &db->save)) {
+        db_snapshot_release(db->save.snapshot);
+        db->save.snapshot = NULL;
+        return 0;
+    }
+    
+    db->save.active = 1;
+    return 1;
+}
+
+/*
+ * Сообщить о ходе фонового сохранения. Возвращает 1, пока сохранение
+ * выполняется, и 0, когда сохранения нет или оно только что завершилось.
+ */
+int db_save_poll(RepositoryDB* db)
+{
+    long total;
+    
+    if (db == NULL || !db->save.active) {
+        return 0;
+    }
+    
+    if (!db->save.finished) {
+        total = db->save.progress.total > 0 ? db->save.progress.total : 1;
+        printf("Сохранение в '%s': %ld%%\n", db->save.filename,
+            db->save.progress.written * 100 / total);
+        return 1;
+    }
+    
+    if (save_reap(db)) {
+        printf("Сохранение в '%s' завершено\n", db->save.filename);
+    } else {
+        fprintf(stderr, "Сохранение в '%s' не выполнено, прежний файл не изменён\n",
+            db->save.filename);
+    }
+    return 0;
+}
+
+/* Дождаться фонового сохранения, например перед выходом */
+int db_save_wait(RepositoryDB* db)
+{
+    if (db == NULL || !db->save.active) {
+        return 1;
+    }
+    
+    if (!db->save.finished) {
+        printf("Ожидание завершения сохранения в '%s'...\n", db->save.filename);
+    }
+    return save_reap(db);
+}
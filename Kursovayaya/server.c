@@ -0,0 +1,775 @@
+/**
+ * @file server.c
+ * @brief База данных репозитория - сервер запросов и генератор нагрузки
+ * @author Костопраев Дмитрий Евгеньевич
+ *
+ * Кадр протокола: uint32 длина тела, затем тело.
+ * Запрос:  uint8 операция, аргументы операции.
+ * Ответ:   uint8 статус (PROTO_OK / PROTO_ERROR), данные ответа.
+ * Ответы приходят в порядке запросов, поэтому запросы можно слать пачкой.
+ * PROTO_SAVE не имеет аргументов: база сохраняется в фоне в файл, заданный
+ * при запуске сервера, а ответ PROTO_OK означает, что сохранение начато.
+ * Пока неотправленных ответов соединения больше OUTPUT_LIMIT, новые
+ * запросы от него не читаются.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "repository.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define MAX_EVENTS 64
+#define READ_CHUNK 65536
+#define OUTPUT_LIMIT (1 << 20)
+#define SAVE_POLL_MS 100
+
+typedef struct {
+    int fd;
+    int want_read;
+    int want_write;
+    Buffer in;
+    Buffer out;
+} Connection;
+
+static volatile sig_atomic_t server_running = 1;
+
+static void handle_stop_signal(int sig)
+{
+    (void)sig;
+    server_running = 0;
+}
+
+static uint32_t get_u32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static double now_ms()
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Заголовок ответа пишется заранее, длина проставляется в finish_response */
+static size_t begin_response(Buffer* out, unsigned char status)
+{
+    uint32_t length = 0;
+    size_t start = out->length;
+    
+    if (!buffer_put(out, &length, sizeof(length)) || !buffer_put(out, &status, 1)) {
+        return (size_t)-1;
+    }
+    return start;
+}
+
+static int finish_response(Buffer* out, size_t start)
+{
+    uint32_t length;
+    
+    if (start == (size_t)-1) {
+        return 0;
+    }
+    
+    length = (uint32_t)(out->length - start - sizeof(uint32_t));
+    memcpy(out->data + start, &length, sizeof(length));
+    return 1;
+}
+
+static int respond_error(Buffer* out)
+{
+    return finish_response(out, begin_response(out, PROTO_ERROR));
+}
+
+static int respond_search(Buffer* out, SearchResult* result)
+{
+    size_t start = begin_response(out, PROTO_OK);
+    uint32_t count = (uint32_t)result->count;
+    int ok;
+    
+    ok = buffer_put(out, &count, sizeof(count)) &&
+         buffer_put(out, result->indices, result->count * sizeof(int));
+    search_result_free(result);
+    
+    return ok && finish_response(out, start);
+}
+
+/* Агрегат по направлениям: число записей, суммарный размер и зависимости */
+static int respond_aggregate(Buffer* out, RepositoryDB* db)
+{
+    int32_t counts[DIRECTION_COUNT] = { 0 };
+    int64_t sizes[DIRECTION_COUNT] = { 0 };
+    int64_t deps[DIRECTION_COUNT] = { 0 };
+    size_t start;
+    int i;
+    
+    for (i = 0; i < db->count; i++) {
+        if (db->dead[i]) {
+            continue;
+        }
+        counts[db->records[i].direction]++;
+        sizes[db->records[i].direction] += db->records[i].size;
+        deps[db->records[i].direction] += db->records[i].dependencies;
+    }
+    
+    start = begin_response(out, PROTO_OK);
+    for (i = 0; i < DIRECTION_COUNT; i++) {
+        if (!buffer_put(out, &counts[i], sizeof(counts[i])) ||
+            !buffer_put(out, &sizes[i], sizeof(sizes[i])) ||
+            !buffer_put(out, &deps[i], sizeof(deps[i]))) {
+            return 0;
+        }
+    }
+    return finish_response(out, start);
+}
+
+/* Строка в кадре: uint8 длина и байты без завершающего нуля */
+static int read_wire_string(const unsigned char** p, const unsigned char* end, char* dest, int size)
+{
+    int length;
+    
+    if (*p >= end) {
+        return 0;
+    }
+    length = **p;
+    (*p)++;
+    
+    if (length >= size || *p + length > end) {
+        return 0;
+    }
+    memcpy(dest, *p, length);
+    dest[length] = '\0';
+    *p += length;
+    return 1;
+}
+
+static int decode_record(const unsigned char* p, const unsigned char* end, Repository* record)
+{
+    uint16_t year;
+    int32_t value;
+    
+    if (end - p < 14) {
+        return 0;
+    }
+    
+    record->direction = (Direction)p[0];
+    record->compatibility = (Compatibility)p[1];
+    record->release_date.day = p[2];
+    record->release_date.month = p[3];
+    memcpy(&year, p + 4, sizeof(year));
+    record->release_date.year = year;
+    memcpy(&value, p + 6, sizeof(value));
+    record->size = value;
+    memcpy(&value, p + 10, sizeof(value));
+    record->dependencies = value;
+    p += 14;
+    
+    if (!read_wire_string(&p, end, record->site, MAX_LONG_STR) ||
+        !read_wire_string(&p, end, record->name, MAX_LONG_STR)) {
+        return 0;
+    }
+    
+    return record->direction < DIRECTION_COUNT &&
+           record->compatibility < COMPAT_COUNT &&
+           record->size > 0 && record->dependencies >= 0 &&
+           validate_date(record->release_date);
+}
+
+static int handle_request(RepositoryDB* db, const char* data_file,
+                          const unsigned char* p, uint32_t length, Buffer* out)
+{
+    const unsigned char* end = p + length;
+    SearchResult result;
+    Repository record;
+    Date date;
+    uint16_t year;
+    int32_t size;
+    uint32_t index;
+    size_t start;
+    
+    if (length < 1) {
+        return respond_error(out);
+    }
+    
+    switch (p[0]) {
+        case PROTO_SEARCH_DIRECTION:
+            if (length != 2 || p[1] >= DIRECTION_COUNT) {
+                return respond_error(out);
+            }
+            result = db_search_by_direction(db, (Direction)p[1]);
+            return respond_search(out, &result);
+            
+        case PROTO_SEARCH_COMBINED:
+            if (length != 9) {
+                return respond_error(out);
+            }
+            date.day = p[1];
+            date.month = p[2];
+            memcpy(&year, p + 3, sizeof(year));
+            date.year = year;
+            memcpy(&size, p + 5, sizeof(size));
+            result = db_search_combined(db, date, size);
+            return respond_search(out, &result);
+            
+        case PROTO_AGGREGATE:
+            return respond_aggregate(out, db);
+            
+        case PROTO_ADD:
+            if (!decode_record(p + 1, end, &record) || !db_add_record(db, &record)) {
+                return respond_error(out);
+            }
+            index = (uint32_t)(db->count - 1);
+            start = begin_response(out, PROTO_OK);
+            return buffer_put(out, &index, sizeof(index)) && finish_response(out, start);
+            
+        case PROTO_SAVE:
+            /* Путь от клиента не принимается: сохранять можно только файл сервера */
+            if (length != 1 || data_file == NULL || !db_save_async(db, data_file)) {
+                return respond_error(out);
+            }
+            return finish_response(out, begin_response(out, PROTO_OK));
+            
+        default:
+            return respond_error(out);
+    }
+}
+
+static int output_full(const Connection* conn)
+{
+    return conn->out.length - conn->out.offset >= OUTPUT_LIMIT;
+}
+
+/*
+ * Обработать полные кадры во входном буфере, пока очередь ответов не
+ * заполнена; остальные дождутся её отправки. 0 - закрыть соединение.
+ */
+static int process_input(RepositoryDB* db, const char* data_file, Connection* conn)
+{
+    uint32_t length;
+    
+    while (!output_full(conn) && conn->in.length - conn->in.offset >= sizeof(uint32_t)) {
+        length = get_u32(conn->in.data + conn->in.offset);
+        if (length > PROTO_MAX_FRAME) {
+            fprintf(stderr, "Слишком длинный кадр (%u байт), соединение закрыто\n", length);
+            return 0;
+        }
+        if (conn->in.length - conn->in.offset < sizeof(uint32_t) + length) {
+            break;
+        }
+        
+        if (!handle_request(db, data_file, conn->in.data + conn->in.offset + sizeof(uint32_t),
+                            length, &conn->out)) {
+            return 0;
+        }
+        conn->in.offset += sizeof(uint32_t) + length;
+    }
+    
+    buffer_compact(&conn->in);
+    return 1;
+}
+
+/* Отправить сколько примет сокет; 0 - ошибка соединения */
+static int flush_output(Connection* conn)
+{
+    ssize_t sent;
+    
+    while (conn->out.offset < conn->out.length) {
+        sent = send(conn->fd, conn->out.data + conn->out.offset,
+                    conn->out.length - conn->out.offset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        conn->out.offset += (size_t)sent;
+    }
+    
+    buffer_compact(&conn->out);
+    return 1;
+}
+
+static void close_connection(int epoll_fd, Connection* conn)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    buffer_free(&conn->in);
+    buffer_free(&conn->out);
+    free(conn);
+}
+
+/* Чтение приостанавливается, пока клиент не заберёт накопленные ответы */
+static int update_interest(int epoll_fd, Connection* conn)
+{
+    struct epoll_event event;
+    int want_read = !output_full(conn);
+    int want_write = conn->out.length > conn->out.offset;
+    
+    if (want_read == conn->want_read && want_write == conn->want_write) {
+        return 1;
+    }
+    
+    event.events = (want_read ? EPOLLIN : 0) | (want_write ? EPOLLOUT : 0);
+    event.data.ptr = conn;
+    conn->want_read = want_read;
+    conn->want_write = want_write;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) == 0;
+}
+
+static int accept_clients(int epoll_fd, int listen_fd)
+{
+    struct epoll_event event;
+    Connection* conn;
+    int fd;
+    
+    while (1) {
+        fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 1;
+            }
+            perror("Ошибка accept");
+            return 0;
+        }
+        
+        conn = (Connection*)calloc(1, sizeof(Connection));
+        if (conn == NULL) {
+            fprintf(stderr, "Ошибка выделения памяти для соединения\n");
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->want_read = 1;
+        
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            perror("Ошибка epoll_ctl");
+            close(fd);
+            free(conn);
+        }
+    }
+}
+
+static int serve_readable(RepositoryDB* db, const char* data_file, Connection* conn)
+{
+    ssize_t received;
+    
+    while (!output_full(conn)) {
+        if (!buffer_reserve(&conn->in, READ_CHUNK)) {
+            return 0;
+        }
+        
+        received = recv(conn->fd, conn->in.data + conn->in.length, READ_CHUNK, 0);
+        if (received > 0) {
+            conn->in.length += (size_t)received;
+            if (!process_input(db, data_file, conn)) {
+                return 0;
+            }
+            continue;
+        }
+        if (received == 0) {
+            return 0;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        return 0;
+    }
+    
+    return 1;
+}
+
+/*
+ * Перед bind удаляется только сокет, оставшийся от аварийно завершённого
+ * сервера: к нему нельзя подключиться. Обычный файл (например, путь указан
+ * с ошибкой) и сокет работающего сервера не трогаются.
+ */
+static int remove_stale_socket(const struct sockaddr_un* addr)
+{
+    struct stat st;
+    int fd;
+    int refused;
+    
+    if (lstat(addr->sun_path, &st) != 0) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        perror("Ошибка проверки пути сокета");
+        return 0;
+    }
+    
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "Ошибка: '%s' уже существует и не является сокетом\n", addr->sun_path);
+        return 0;
+    }
+    
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Ошибка создания сокета");
+        return 0;
+    }
+    refused = connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) != 0 && errno == ECONNREFUSED;
+    close(fd);
+    
+    if (!refused) {
+        fprintf(stderr, "Ошибка: сокет '%s' занят другим сервером или недоступен\n", addr->sun_path);
+        return 0;
+    }
+    
+    if (unlink(addr->sun_path) != 0 && errno != ENOENT) {
+        perror("Ошибка удаления старого сокета");
+        return 0;
+    }
+    return 1;
+}
+
+static int open_listen_socket(const char* socket_path)
+{
+    struct sockaddr_un addr;
+    int fd;
+    
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Ошибка: слишком длинный путь к сокету\n");
+        return -1;
+    }
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    if (!remove_stale_socket(&addr)) {
+        return -1;
+    }
+    
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Ошибка создания сокета");
+        return -1;
+    }
+    
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror("Ошибка привязки сокета");
+        close(fd);
+        return -1;
+    }
+    
+    return fd;
+}
+
+int run_server(const char* socket_path, const char* data_file)
+{
+    RepositoryDB db;
+    struct epoll_event event;
+    struct epoll_event events[MAX_EVENTS];
+    Connection* conn;
+    int listen_fd;
+    int epoll_fd;
+    int ready;
+    int i;
+    
+    if (socket_path == NULL) {
+        fprintf(stderr, "Ошибка: не задан путь к сокету\n");
+        return 0;
+    }
+    
+    if (!db_init(&db)) {
+        return 0;
+    }
+    if (data_file != NULL && !db_load_from_file(&db, data_file)) {
+        db_free(&db);
+        return 0;
+    }
+    
+    listen_fd = open_listen_socket(socket_path);
+    if (listen_fd < 0) {
+        db_free(&db);
+        return 0;
+    }
+    
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0) {
+        perror("Ошибка epoll");
+        if (epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+        close(listen_fd);
+        unlink(socket_path);
+        db_free(&db);
+        return 0;
+    }
+    
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+    signal(SIGPIPE, SIG_IGN);
+    
+    printf("Сервер слушает '%s' (%d записей)\n", socket_path, db.count);
+    
+    /* Соединения, оставшиеся открытыми при остановке, закрывает выход процесса */
+    while (server_running) {
+        /* Пока идёт фоновое сохранение, цикл просыпается, чтобы сообщить о его завершении */
+        ready = epoll_wait(epoll_fd, events, MAX_EVENTS, db.save.active ? SAVE_POLL_MS : -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Ошибка epoll_wait");
+            break;
+        }
+        
+        if (db.save.active && db.save.finished) {
+            db_save_poll(&db);
+        }
+        
+        for (i = 0; i < ready; i++) {
+            conn = (Connection*)events[i].data.ptr;
+            
+            if (conn == NULL) {
+                accept_clients(epoll_fd, listen_fd);
+                continue;
+            }
+            
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN)) {
+                close_connection(epoll_fd, conn);
+                continue;
+            }
+            
+            if ((events[i].events & EPOLLIN) && !serve_readable(&db, data_file, conn)) {
+                flush_output(conn);
+                close_connection(epoll_fd, conn);
+                continue;
+            }
+            
+            /* После отправки ответов дообработать отложенные кадры */
+            if (!flush_output(conn) || !process_input(&db, data_file, conn) ||
+                !update_interest(epoll_fd, conn)) {
+                close_connection(epoll_fd, conn);
+            }
+        }
+    }
+    
+    printf("\nСервер остановлен\n");
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(socket_path);
+    db_free(&db);
+    return 1;
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Смесь запросов: поиск по направлению, комбинированный поиск и агрегат */
+static size_t encode_request(unsigned char* frame, int n)
+{
+    uint32_t length;
+    uint16_t year = 2024;
+    int32_t size = 128;
+    
+    switch (n % 4) {
+        case 0:
+        case 1:
+            length = 2;
+            frame[4] = PROTO_SEARCH_DIRECTION;
+            frame[5] = (unsigned char)(n % DIRECTION_COUNT);
+            break;
+        case 2:
+            length = 9;
+            frame[4] = PROTO_SEARCH_COMBINED;
+            frame[5] = 20;
+            frame[6] = 6;
+            memcpy(frame + 7, &year, sizeof(year));
+            memcpy(frame + 9, &size, sizeof(size));
+            break;
+        default:
+            length = 1;
+            frame[4] = PROTO_AGGREGATE;
+            break;
+    }
+    
+    memcpy(frame, &length, sizeof(length));
+    return sizeof(length) + length;
+}
+
+static int send_all(int fd, const unsigned char* data, size_t size)
+{
+    ssize_t sent;
+    
+    while (size > 0) {
+        sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return 1;
+}
+
+int run_loadgen(const char* socket_path, int requests, int pipeline)
+{
+    struct sockaddr_un addr;
+    unsigned char frame[16];
+    Buffer batch = { NULL, 0, 0, 0 };
+    Buffer in = { NULL, 0, 0, 0 };
+    double* sent_at;
+    double* latencies;
+    double started;
+    double elapsed;
+    ssize_t received;
+    uint32_t length;
+    int sent = 0;
+    int done = 0;
+    int errors = 0;
+    int fd;
+    int ok = 1;
+    
+    if (socket_path == NULL || requests <= 0 || pipeline <= 0) {
+        fprintf(stderr, "Ошибка: некорректные параметры генератора нагрузки\n");
+        return 0;
+    }
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Ошибка: слишком длинный путь к сокету\n");
+        return 0;
+    }
+    
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("Ошибка подключения к серверу");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    
+    sent_at = (double*)malloc(requests * sizeof(double));
+    latencies = (double*)malloc(requests * sizeof(double));
+    if (sent_at == NULL || latencies == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для замеров\n");
+        free(sent_at);
+        free(latencies);
+        close(fd);
+        return 0;
+    }
+    
+    started = now_ms();
+    
+    while (done < requests && ok) {
+        /* Дослать запросы до глубины конвейера одной пачкой */
+        batch.length = 0;
+        while (sent < requests && sent - done < pipeline) {
+            if (!buffer_put(&batch, frame, encode_request(frame, sent))) {
+                ok = 0;
+                break;
+            }
+            sent_at[sent] = now_ms();
+            sent++;
+        }
+        if (batch.length > 0 && !send_all(fd, batch.data, batch.length)) {
+            perror("Ошибка отправки");
+            ok = 0;
+            break;
+        }
+        
+        if (!buffer_reserve(&in, READ_CHUNK)) {
+            ok = 0;
+            break;
+        }
+        received = recv(fd, in.data + in.length, READ_CHUNK, 0);
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Сервер закрыл соединение\n");
+            ok = 0;
+            break;
+        }
+        in.length += (size_t)received;
+        
+        while (in.length - in.offset >= sizeof(uint32_t)) {
+            length = get_u32(in.data + in.offset);
+            if (in.length - in.offset < sizeof(uint32_t) + length) {
+                break;
+            }
+            if (length < 1 || in.data[in.offset + sizeof(uint32_t)] != PROTO_OK) {
+                errors++;
+            }
+            latencies[done] = now_ms() - sent_at[done];
+            done++;
+            in.offset += sizeof(uint32_t) + length;
+        }
+        buffer_compact(&in);
+    }
+    
+    elapsed = now_ms() - started;
+    
+    if (done > 0) {
+        qsort(latencies, done, sizeof(double), compare_doubles);
+        printf("Запросов: %d, ошибок: %d, конвейер: %d\n", done, errors, pipeline);
+        printf("Время: %.1f мс, QPS: %.0f\n", elapsed, done / (elapsed / 1000.0));
+        printf("Задержка: p50 %.3f мс, p99 %.3f мс, max %.3f мс\n",
+            latencies[done / 2], latencies[(int)((done - 1) * 0.99)], latencies[done - 1]);
+    }
+    
+    buffer_free(&batch);
+    buffer_free(&in);
+    free(sent_at);
+    free(latencies);
+    close(fd);
+    return ok;
+}
+
+#else
+
+int run_server(const char* socket_path, const char* data_file)
+{
+    (void)socket_path;
+    (void)data_file;
+    fprintf(stderr, "Режим сервера доступен только в Linux\n");
+    return 0;
+}
+
+int run_loadgen(const char* socket_path, int requests, int pipeline)
+{
+    (void)socket_path;
+    (void)requests;
+    (void)pipeline;
+    fprintf(stderr, "Генератор нагрузки доступен только в Linux\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,782 @@
+/**
+ * @file sketch.c
+ * @brief База данных репозитория - приближённая статистика (скетчи)
+ * @author Костопраев Дмитрий Евгеньевич
+ *
+ * Скетчи занимают фиксированную память и отвечают за постоянное время:
+ *   HyperLogLog - число различных сайтов, хостов и названий,
+ *     ошибка около 1.04 / sqrt(HLL_REGISTERS) (1.6%);
+ *   Count-Min - частота значения, завышение не больше e / CMS_WIDTH
+ *     от числа записей с вероятностью 1 - e^-CMS_DEPTH, плюс список
+ *     HEAVY_HITTERS самых частых значений;
+ *   логарифмические корзины (как в DDSketch) - квантили размера и
+ *     зависимостей с относительной ошибкой QUANTILE_ALPHA.
+ * Скетчи можно сливать: так они строятся параллельно по частям таблицы.
+ * При удалении или изменении записи прежние значения исключаются из
+ * квантилей и числа записей; HyperLogLog и Count-Min удалять не умеют
+ * и учитывают их до уплотнения, при котором скетчи строятся заново.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "repository.h"
+
+#define SKETCH_MAGIC "RPS1"
+
+typedef struct {
+    RepositoryDB* db;
+    int first;
+    int last;
+    RepositorySketches* sketches;
+} SketchTask;
+
+/* 64-битный FNV-1a с перемешиванием: HLL берёт из хеша и номер регистра, и ранг */
+static unsigned long long hash_string(const char* data, int length)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    int i;
+    
+    for (i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+    }
+    
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static void hll_add(HyperLogLog* hll, unsigned long long hash)
+{
+    int index = (int)(hash >> (64 - HLL_PRECISION));
+    unsigned long long rest = hash << HLL_PRECISION;
+    unsigned char rank = 1;
+    
+    while (rank <= 64 - HLL_PRECISION && !(rest & 0x8000000000000000ull)) {
+        rest <<= 1;
+        rank++;
+    }
+    
+    if (rank > hll->registers[index]) {
+        hll->registers[index] = rank;
+    }
+}
+
+/* Оценка числа различных значений; для малых чисел - линейный подсчёт */
+double hll_estimate(const HyperLogLog* hll)
+{
+    double m = HLL_REGISTERS;
+    double sum = 0.0;
+    double estimate;
+    int zeros = 0;
+    int i;
+    
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -hll->registers[i]);
+        zeros += hll->registers[i] == 0;
+    }
+    
+    estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros);
+    }
+    return estimate;
+}
+
+static void hll_merge(HyperLogLog* dst, const HyperLogLog* src)
+{
+    int i;
+    
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        if (src->registers[i] > dst->registers[i]) {
+            dst->registers[i] = src->registers[i];
+        }
+    }
+}
+
+/* Строки таблицы Count-Min индексируются двумя половинами одного хеша */
+static unsigned int cms_min(const FrequencySketch* freq, unsigned long long hash)
+{
+    unsigned int low = (unsigned int)hash;
+    unsigned int high = (unsigned int)(hash >> 32);
+    unsigned int result = 0;
+    unsigned int count;
+    int row;
+    
+    for (row = 0; row < CMS_DEPTH; row++) {
+        count = freq->counts[row][(low + row * high) % CMS_WIDTH];
+        if (row == 0 || count < result) {
+            result = count;
+        }
+    }
+    return result;
+}
+
+/* Обновить кандидата в самые частые значения оценкой count */
+static void heavy_offer(FrequencySketch* freq, const char* value, int length,
+                        unsigned long long hash, unsigned int count)
+{
+    HeavyHitter* slot = NULL;
+    int i;
+    
+    for (i = 0; i < freq->top_count; i++) {
+        if (freq->top[i].hash == hash && strncmp(freq->top[i].value, value, length) == 0 &&
+            freq->top[i].value[length] == '\0') {
+            freq->top[i].count = count;
+            return;
+        }
+        if (slot == NULL || freq->top[i].count < slot->count) {
+            slot = &freq->top[i];
+        }
+    }
+    
+    if (freq->top_count < HEAVY_HITTERS) {
+        slot = &freq->top[freq->top_count++];
+    } else if (count <= slot->count) {
+        return;
+    }
+    
+    memcpy(slot->value, value, length);
+    slot->value[length] = '\0';
+    slot->hash = hash;
+    slot->count = count;
+}
+
+/*
+ * Консервативное обновление: увеличиваются только счётчики, равные минимуму.
+ * Оценка по-прежнему не меньше истинной, но завышение заметно меньше.
+ */
+static void frequency_add(FrequencySketch* freq, const char* value, int length, unsigned long long hash)
+{
+    unsigned int low = (unsigned int)hash;
+    unsigned int high = (unsigned int)(hash >> 32);
+    unsigned int estimate = cms_min(freq, hash) + 1;
+    unsigned int* counter;
+    int row;
+    
+    for (row = 0; row < CMS_DEPTH; row++) {
+        counter = &freq->counts[row][(low + row * high) % CMS_WIDTH];
+        if (*counter < estimate) {
+            *counter = estimate;
+        }
+    }
+    heavy_offer(freq, value, length, hash, estimate);
+}
+
+/* Оценка частоты значения: не меньше истинной */
+unsigned int frequency_estimate(const FrequencySketch* freq, const char* value)
+{
+    return cms_min(freq, hash_string(value, (int)strlen(value)));
+}
+
+static void frequency_merge(FrequencySketch* dst, const FrequencySketch* src)
+{
+    HeavyHitter candidates[HEAVY_HITTERS];
+    int count = dst->top_count;
+    int row, i;
+    
+    for (row = 0; row < CMS_DEPTH; row++) {
+        for (i = 0; i < CMS_WIDTH; i++) {
+            dst->counts[row][i] += src->counts[row][i];
+        }
+    }
+    
+    /* Кандидаты обеих сторон переоцениваются по общей таблице */
+    memcpy(candidates, dst->top, count * sizeof(HeavyHitter));
+    dst->top_count = 0;
+    for (i = 0; i < count; i++) {
+        heavy_offer(dst, candidates[i].value, (int)strlen(candidates[i].value),
+                    candidates[i].hash, cms_min(dst, candidates[i].hash));
+    }
+    for (i = 0; i < src->top_count; i++) {
+        heavy_offer(dst, src->top[i].value, (int)strlen(src->top[i].value),
+                    src->top[i].hash, cms_min(dst, src->top[i].hash));
+    }
+}
+
+static int compare_heavy(const void* a, const void* b)
+{
+    const HeavyHitter* x = (const HeavyHitter*)a;
+    const HeavyHitter* y = (const HeavyHitter*)b;
+    
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return strcmp(x->value, y->value);
+}
+
+/* Самые частые значения по убыванию оценки; возвращает их число */
+int frequency_top(const FrequencySketch* freq, HeavyHitter* out)
+{
+    memcpy(out, freq->top, freq->top_count * sizeof(HeavyHitter));
+    qsort(out, freq->top_count, sizeof(HeavyHitter), compare_heavy);
+    return freq->top_count;
+}
+
+/*
+ * gamma = (1 + QUANTILE_ALPHA) / (1 - QUANTILE_ALPHA) и её логарифм - постоянные:
+ * логарифм вычислен заранее, а не при каждом добавлении значения. При
+ * изменении QUANTILE_ALPHA его нужно пересчитать вместе с QUANTILE_BINS.
+ */
+#define QUANTILE_GAMMA ((1.0 + QUANTILE_ALPHA) / (1.0 - QUANTILE_ALPHA))
+#define QUANTILE_LOG_GAMMA 0.020000666706669435
+
+/* Корзина k содержит значения из (gamma^(k-1), gamma^k] */
+static int quantile_bin(int value)
+{
+    int bin = (int)ceil(log((double)value) / QUANTILE_LOG_GAMMA);
+    
+    return bin < QUANTILE_BINS ? bin : QUANTILE_BINS - 1;
+}
+
+static void quantile_add(QuantileSketch* q, int value)
+{
+    if (q->total == 0 || value < q->min) {
+        q->min = value;
+    }
+    if (q->total == 0 || value > q->max) {
+        q->max = value;
+    }
+    q->total++;
+    
+    if (value <= 0) {
+        q->zeros++;
+    } else {
+        q->bins[quantile_bin(value)]++;
+    }
+}
+
+/* Границы min и max не сужаются: это по-прежнему верные оценки снизу и сверху */
+static void quantile_remove(QuantileSketch* q, int value)
+{
+    unsigned int* bucket = value <= 0 ? &q->zeros : &q->bins[quantile_bin(value)];
+    
+    if (q->total > 0 && *bucket > 0) {
+        (*bucket)--;
+        q->total--;
+    }
+}
+
+/* Значение квантиля fraction (0..1) с относительной ошибкой QUANTILE_ALPHA */
+int quantile_value(const QuantileSketch* q, double fraction)
+{
+    double rank;
+    double gamma = QUANTILE_GAMMA;
+    double value;
+    unsigned int seen;
+    int k;
+    
+    if (q->total == 0) {
+        return 0;
+    }
+    
+    rank = fraction * (q->total - 1);
+    seen = q->zeros;
+    if (rank < seen) {
+        return q->min < 0 ? q->min : 0;
+    }
+    
+    for (k = 0; k < QUANTILE_BINS; k++) {
+        seen += q->bins[k];
+        if (rank < seen) {
+            break;
+        }
+    }
+    
+    value = 2.0 * pow(gamma, k) / (gamma + 1.0);
+    if (value < q->min) {
+        return q->min;
+    }
+    return value > q->max ? q->max : (int)(value + 0.5);
+}
+
+/*
+ * Число значений больше threshold. Корзина, в которую попадает порог,
+ * делится пропорционально: ошибка - только записи этой корзины, то есть
+ * значения в пределах QUANTILE_ALPHA от порога.
+ */
+unsigned int quantile_count_above(const QuantileSketch* q, int threshold)
+{
+    double gamma = QUANTILE_GAMMA;
+    double lower;
+    double upper;
+    double above = 0.0;
+    int bin;
+    int k;
+    
+    if (q->total == 0 || threshold >= q->max) {
+        return 0;
+    }
+    if (threshold < q->min) {
+        return q->total;
+    }
+    if (threshold <= 0) {
+        return q->total - q->zeros;
+    }
+    
+    bin = quantile_bin(threshold);
+    for (k = bin + 1; k < QUANTILE_BINS; k++) {
+        above += q->bins[k];
+    }
+    
+    lower = pow(gamma, bin - 1);
+    upper = pow(gamma, bin);
+    if (threshold < upper) {
+        above += q->bins[bin] * (upper - threshold) / (upper - lower);
+    }
+    return (unsigned int)(above + 0.5);
+}
+
+static void quantile_merge(QuantileSketch* dst, const QuantileSketch* src)
+{
+    int k;
+    
+    if (src->total == 0) {
+        return;
+    }
+    if (dst->total == 0 || src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (dst->total == 0 || src->max > dst->max) {
+        dst->max = src->max;
+    }
+    
+    dst->total += src->total;
+    dst->zeros += src->zeros;
+    for (k = 0; k < QUANTILE_BINS; k++) {
+        dst->bins[k] += src->bins[k];
+    }
+}
+
+void sketches_reset(RepositorySketches* sketches)
+{
+    memset(sketches, 0, sizeof(RepositorySketches));
+}
+
+void sketches_add(RepositorySketches* sketches, const Repository* record)
+{
+    int host_length = site_host_length(record->site);
+    int name_length = (int)strlen(record->name);
+    unsigned long long name_hash = hash_string(record->name, name_length);
+    unsigned long long host_hash = hash_string(record->site, host_length);
+    
+    sketches->count++;
+    hll_add(&sketches->sites, hash_string(record->site, (int)strlen(record->site)));
+    hll_add(&sketches->names, name_hash);
+    frequency_add(&sketches->name_freq, record->name, name_length, name_hash);
+    if (host_length > 0) {
+        hll_add(&sketches->hosts, host_hash);
+        frequency_add(&sketches->host_freq, record->site, host_length, host_hash);
+    }
+    quantile_add(&sketches->size, record->size);
+    quantile_add(&sketches->dependencies, record->dependencies);
+}
+
+/* Исключить запись, ранее учтённую sketches_add */
+void sketches_remove(RepositorySketches* sketches, const Repository* record)
+{
+    if (sketches->count > 0) {
+        sketches->count--;
+    }
+    quantile_remove(&sketches->size, record->size);
+    quantile_remove(&sketches->dependencies, record->dependencies);
+}
+
+void sketches_merge(RepositorySketches* dst, const RepositorySketches* src)
+{
+    dst->count += src->count;
+    hll_merge(&dst->sites, &src->sites);
+    hll_merge(&dst->hosts, &src->hosts);
+    hll_merge(&dst->names, &src->names);
+    frequency_merge(&dst->name_freq, &src->name_freq);
+    frequency_merge(&dst->host_freq, &src->host_freq);
+    quantile_merge(&dst->size, &src->size);
+    quantile_merge(&dst->dependencies, &src->dependencies);
+}
+
+static void sketch_range(RepositoryDB* db, RepositorySketches* sketches, int first, int last)
+{
+    int i;
+    
+    for (i = first; i < last; i++) {
+        if (!db->dead[i]) {
+            sketches_add(sketches, &db->records[i]);
+        }
+    }
+}
+
+static int sketch_worker(void* arg)
+{
+    SketchTask* task = (SketchTask*)arg;
+    
+    sketch_range(task->db, task->sketches, task->first, task->last);
+    return 1;
+}
+
+/*
+ * Пересчитать скетчи по живым записям. Большая таблица делится между
+ * потоками, частичные скетчи сливаются.
+ */
+int db_rebuild_sketches(RepositoryDB* db)
+{
+    platform_thread* threads;
+    SketchTask* tasks;
+    int thread_count = platform_cpu_count();
+    int started = 0;
+    int t;
+    
+    if (db == NULL || db->sketches == NULL) {
+        return 0;
+    }
+    
+    sketches_reset(db->sketches);
+    if (thread_count <= 1 || db->count < SKETCH_PARALLEL_MIN_RECORDS) {
+        sketch_range(db, db->sketches, 0, db->count);
+        return 1;
+    }
+    
+    threads = (platform_thread*)malloc(thread_count * sizeof(platform_thread));
+    tasks = (SketchTask*)calloc(thread_count, sizeof(SketchTask));
+    if (threads == NULL || tasks == NULL) {
+        free(threads);
+        free(tasks);
+        sketch_range(db, db->sketches, 0, db->count);
+        return 1;
+    }
+    
+    /* Последняя часть обрабатывается в текущем потоке прямо в скетчи БД */
+    for (t = 0; t < thread_count; t++) {
+        tasks[t].db = db;
+        tasks[t].first = (int)((long long)db->count * t / thread_count);
+        tasks[t].last = (int)((long long)db->count * (t + 1) / thread_count);
+    }
+    for (t = 0; t < thread_count - 1; t++) {
+        tasks[t].sketches = (RepositorySketches*)calloc(1, sizeof(RepositorySketches));
+        if (tasks[t].sketches == NULL ||
+            !platform_thread_create(&threads[t], sketch_worker, &tasks[t])) {
+            free(tasks[t].sketches);
+            break;
+        }
+        started++;
+    }
+    
+    sketch_range(db, db->sketches, tasks[started].first, db->count);
+    for (t = 0; t < started; t++) {
+        platform_thread_join(threads[t]);
+        sketches_merge(db->sketches, tasks[t].sketches);
+        free(tasks[t].sketches);
+    }
+    
+    free(threads);
+    free(tasks);
+    return 1;
+}
+
+static int put_u32(Buffer* buf, unsigned int value)
+{
+    return buffer_put(buf, &value, 4);
+}
+
+static unsigned int get_u32(const unsigned char* p)
+{
+    unsigned int value;
+    
+    memcpy(&value, p, 4);
+    return value;
+}
+
+/*
+ * Счётчики пишутся varint, серия нулей - одним нулём и длиной серии:
+ * у небольшой БД почти все ячейки пусты, и секция занимает сотни байт.
+ */
+static int put_counts(Buffer* buf, const unsigned int* counts, int n)
+{
+    int run;
+    int i = 0;
+    
+    while (i < n) {
+        if (!buffer_put_varint(buf, counts[i])) {
+            return 0;
+        }
+        if (counts[i++] == 0) {
+            for (run = 0; i < n && counts[i] == 0; i++) {
+                run++;
+            }
+            if (!buffer_put_varint(buf, run)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int get_counts(const unsigned char** p, const unsigned char* end, unsigned int* counts, int n)
+{
+    unsigned long value;
+    unsigned long run;
+    int i = 0;
+    
+    while (i < n) {
+        if (!buffer_get_varint(p, end, &value) || value > 0xFFFFFFFFUL) {
+            return 0;
+        }
+        counts[i++] = (unsigned int)value;
+        if (value == 0) {
+            if (!buffer_get_varint(p, end, &run) || run > (unsigned long)(n - i)) {
+                return 0;
+            }
+            memset(counts + i, 0, run * sizeof(unsigned int));
+            i += (int)run;
+        }
+    }
+    return 1;
+}
+
+static int encode_hll(Buffer* buf, const HyperLogLog* hll)
+{
+    unsigned int counts[HLL_REGISTERS];
+    int i;
+    
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        counts[i] = hll->registers[i];
+    }
+    return put_counts(buf, counts, HLL_REGISTERS);
+}
+
+static int decode_hll(const unsigned char** p, const unsigned char* end, HyperLogLog* hll)
+{
+    unsigned int counts[HLL_REGISTERS];
+    int i;
+    
+    if (!get_counts(p, end, counts, HLL_REGISTERS)) {
+        return 0;
+    }
+    for (i = 0; i < HLL_REGISTERS; i++) {
+        if (counts[i] > 64) {
+            return 0;
+        }
+        hll->registers[i] = (unsigned char)counts[i];
+    }
+    return 1;
+}
+
+static int encode_frequency(Buffer* buf, const FrequencySketch* freq)
+{
+    int length;
+    int i;
+    
+    if (!put_counts(buf, &freq->counts[0][0], CMS_DEPTH * CMS_WIDTH) || !put_u32(buf, freq->top_count)) {
+        return 0;
+    }
+    for (i = 0; i < freq->top_count; i++) {
+        length = (int)strlen(freq->top[i].value);
+        if (!put_u32(buf, freq->top[i].count) || !buffer_put_varint(buf, length) ||
+            !buffer_put(buf, freq->top[i].value, length)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int encode_quantiles(Buffer* buf, const QuantileSketch* q)
+{
+    return put_u32(buf, q->total) && put_u32(buf, q->zeros) &&
+           put_u32(buf, (unsigned int)q->min) && put_u32(buf, (unsigned int)q->max) &&
+           put_counts(buf, q->bins, QUANTILE_BINS);
+}
+
+/*
+ * Секция скетчей архива: "RPS1", uint32 длина тела, тело, uint32 CRC32 тела.
+ */
+int sketches_encode(Buffer* buf, const RepositorySketches* sketches)
+{
+    size_t start;
+    size_t length_at;
+    unsigned int length;
+    
+    start = buf->length;
+    if (!buffer_put(buf, SKETCH_MAGIC, 4) || !put_u32(buf, 0)) {
+        return 0;
+    }
+    length_at = buf->length - 4;
+    
+    if (!put_u32(buf, sketches->count) ||
+        !encode_hll(buf, &sketches->sites) ||
+        !encode_hll(buf, &sketches->hosts) ||
+        !encode_hll(buf, &sketches->names) ||
+        !encode_frequency(buf, &sketches->name_freq) ||
+        !encode_frequency(buf, &sketches->host_freq) ||
+        !encode_quantiles(buf, &sketches->size) ||
+        !encode_quantiles(buf, &sketches->dependencies)) {
+        return 0;
+    }
+    
+    length = (unsigned int)(buf->length - start - 8);
+    memcpy(buf->data + length_at, &length, 4);
+    return put_u32(buf, crc32_compute(buf->data + start + 8, length));
+}
+
+static int decode_frequency(const unsigned char** p, const unsigned char* end, FrequencySketch* freq)
+{
+    unsigned long length;
+    int i;
+    
+    if (!get_counts(p, end, &freq->counts[0][0], CMS_DEPTH * CMS_WIDTH) || end - *p < 4) {
+        return 0;
+    }
+    freq->top_count = (int)get_u32(*p);
+    *p += 4;
+    if (freq->top_count < 0 || freq->top_count > HEAVY_HITTERS) {
+        return 0;
+    }
+    
+    for (i = 0; i < freq->top_count; i++) {
+        if (end - *p < 4) {
+            return 0;
+        }
+        freq->top[i].count = get_u32(*p);
+        *p += 4;
+        if (!buffer_get_varint(p, end, &length) || length >= MAX_LONG_STR ||
+            (unsigned long)(end - *p) < length) {
+            return 0;
+        }
+        memcpy(freq->top[i].value, *p, length);
+        freq->top[i].value[length] = '\0';
+        freq->top[i].hash = hash_string(freq->top[i].value, (int)length);
+        *p += length;
+    }
+    return 1;
+}
+
+static int decode_quantiles(const unsigned char** p, const unsigned char* end, QuantileSketch* q)
+{
+    if (end - *p < 16) {
+        return 0;
+    }
+    
+    q->total = get_u32(*p);
+    q->zeros = get_u32(*p + 4);
+    q->min = (int)get_u32(*p + 8);
+    q->max = (int)get_u32(*p + 12);
+    *p += 16;
+    return get_counts(p, end, q->bins, QUANTILE_BINS);
+}
+
+/* Прочитать секцию скетчей из [data, end); 0 - секции нет или она повреждена */
+int sketches_decode(const unsigned char* data, const unsigned char* end, RepositorySketches* sketches)
+{
+    const unsigned char* p;
+    unsigned int length;
+    
+    if (end - data < 12 || memcmp(data, SKETCH_MAGIC, 4) != 0) {
+        return 0;
+    }
+    length = get_u32(data + 4);
+    if ((size_t)(end - data) < (size_t)length + 12 ||
+        crc32_compute(data + 8, length) != get_u32(data + 8 + length)) {
+        return 0;
+    }
+    
+    p = data + 8;
+    end = p + length;
+    sketches_reset(sketches);
+    if (end - p < 4) {
+        return 0;
+    }
+    sketches->count = get_u32(p);
+    p += 4;
+    
+    return decode_hll(&p, end, &sketches->sites) &&
+           decode_hll(&p, end, &sketches->hosts) &&
+           decode_hll(&p, end, &sketches->names) &&
+           decode_frequency(&p, end, &sketches->name_freq) &&
+           decode_frequency(&p, end, &sketches->host_freq) &&
+           decode_quantiles(&p, end, &sketches->size) &&
+           decode_quantiles(&p, end, &sketches->dependencies) && p == end;
+}
+
+/*
+ * 1.04 / sqrt(m) - одна стандартная ошибка HyperLogLog; выводится интервал
+ * в HLL_SIGMAS стандартных ошибок, в который оценка попадает почти всегда.
+ */
+#define HLL_SIGMAS 3
+
+static void print_cardinality(const char* title, const HyperLogLog* hll)
+{
+    double estimate = hll_estimate(hll);
+    double error = HLL_SIGMAS * 1.04 / sqrt((double)HLL_REGISTERS);
+    
+    printf("%-22s ~%.0f (от %.0f до %.0f, ±%.1f%%)\n", title, estimate,
+        estimate * (1.0 - error), estimate * (1.0 + error), 100.0 * error);
+}
+
+/*
+ * Истинная частота лежит между оценкой минус error и оценкой. Кандидат с
+ * оценкой не больше error неотличим от шума коллизий Count-Min и не выводится.
+ */
+static void print_top(const char* title, const FrequencySketch* freq, double error)
+{
+    HeavyHitter top[HEAVY_HITTERS];
+    int count = frequency_top(freq, top);
+    int shown = 0;
+    int i;
+    
+    printf("\n%s:\n", title);
+    for (i = 0; i < count; i++) {
+        if (top[i].count > error) {
+            printf("  %-40s ~%u (не меньше %.0f)\n", top[i].value, top[i].count, ceil(top[i].count - error));
+            shown++;
+        }
+    }
+    if (shown == 0) {
+        printf("  нет значений, частота которых заметно больше погрешности ~%.0f\n", error);
+    }
+}
+
+static void print_quantiles(const char* title, const QuantileSketch* q)
+{
+    printf("%-22s мин %d, p50 ~%d, p90 ~%d, p99 ~%d, макс %d\n", title, q->min,
+        quantile_value(q, 0.5), quantile_value(q, 0.9), quantile_value(q, 0.99), q->max);
+}
+
+/* Вывести приближённую статистику; threshold >= 0 - сколько записей с размером больше него */
+int db_print_sketches(RepositoryDB* db, int threshold)
+{
+    const RepositorySketches* s;
+    double freq_error;
+    
+    if (db == NULL || db->sketches == NULL) {
+        fprintf(stderr, "Ошибка: некорректный параметр в db_print_sketches\n");
+        return 0;
+    }
+    
+    s = db->sketches;
+    printf("\n=== Приближённая статистика (%u записей) ===\n", s->count);
+    if (db->dead_count > 0) {
+        printf("Различные и частые значения учитывают удалённые записи до уплотнения\n");
+    }
+    
+    print_cardinality("Различных сайтов:", &s->sites);
+    print_cardinality("Различных хостов:", &s->hosts);
+    print_cardinality("Различных названий:", &s->names);
+    
+    print_quantiles("Размер, Кб:", &s->size);
+    print_quantiles("Зависимости:", &s->dependencies);
+    printf("(квантили с относительной ошибкой до %.0f%%)\n", QUANTILE_ALPHA * 100);
+    
+    freq_error = s->count * exp(1.0) / CMS_WIDTH;
+    printf("Частоты завышены не больше чем на ~%.0f с вероятностью %.0f%%\n",
+        freq_error, 100.0 * (1.0 - exp(-(double)CMS_DEPTH)));
+    print_top("Самые частые названия", &s->name_freq, freq_error);
+    print_top("Самые частые хосты", &s->host_freq, freq_error);
+    
+    if (threshold >= 0) {
+        printf("\nЗаписей с размером больше %d Кб: ~%u\n", threshold,
+            quantile_count_above(&s->size, threshold));
+    }
+    return 1;
+}
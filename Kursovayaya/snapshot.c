@@ -0,0 +1,400 @@
+/**
+ * @file snapshot.c
+ * @brief База данных репозитория - версии таблицы для параллельного чтения
+ * @author Костопраев Дмитрий Евгеньевич
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "repository.h"
+
+static int chunk_release(RecordChunk* chunk)
+{
+    if (chunk == NULL) {
+        return 0;
+    }
+    
+    if (platform_atomic_dec(&chunk->refs) == 0) {
+        free(chunk);
+    }
+    return 1;
+}
+
+/* Запомнить, что записи начиная с from_index изменились после последней публикации */
+int db_mark_dirty(RepositoryDB* db, int from_index)
+{
+    if (db == NULL) {
+        return 0;
+    }
+    
+    if (from_index < 0) {
+        from_index = 0;
+    }
+    if (from_index < db->dirty_from) {
+        db->dirty_from = from_index;
+    }
+    db->dirty_to = INT_MAX;
+    db->version++;
+    return 1;
+}
+
+/* Запомнить изменение одной записи: при публикации копируется только её кусок */
+int db_mark_changed(RepositoryDB* db, int index)
+{
+    if (db == NULL || index < 0) {
+        return 0;
+    }
+    
+    if (index < db->dirty_from) {
+        db->dirty_from = index;
+    }
+    if (index + 1 > db->dirty_to) {
+        db->dirty_to = index + 1;
+    }
+    db->version++;
+    return 1;
+}
+
+/*
+ * Собрать следующую версию: куски, не пересекающие [dirty_from, dirty_to),
+ * берутся из предыдущей версии, остальные копируются из records. Подмена указателя
+ * выполняется под коротким замком; читатели старой версии её не замечают.
+ */
+int db_publish(RepositoryDB* db)
+{
+    DBSnapshot* next;
+    DBSnapshot* prev;
+    RecordChunk* chunk;
+    int c;
+    int start;
+    int chunk_count;
+    
+    if (db == NULL) {
+        fprintf(stderr, "Ошибка: передан NULL-указатель в db_publish\n");
+        return 0;
+    }
+    
+    next = (DBSnapshot*)malloc(sizeof(DBSnapshot));
+    if (next == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для версии БД\n");
+        return 0;
+    }
+    
+    chunk_count = (db->count + SNAPSHOT_CHUNK_SIZE - 1) / SNAPSHOT_CHUNK_SIZE;
+    next->refs = 1;
+    next->version = db->version;
+    next->count = db->count;
+    next->chunk_count = 0;
+    next->chunks = NULL;
+    
+    if (chunk_count > 0) {
+        next->chunks = (RecordChunk**)malloc(chunk_count * sizeof(RecordChunk*));
+        if (next->chunks == NULL) {
+            fprintf(stderr, "Ошибка выделения памяти для версии БД\n");
+            free(next);
+            return 0;
+        }
+    }
+    
+    prev = db->snapshot;
+    
+    for (c = 0; c < chunk_count; c++) {
+        start = c * SNAPSHOT_CHUNK_SIZE;
+        chunk = NULL;
+        
+        if (prev != NULL && c < prev->chunk_count &&
+            (start + prev->chunks[c]->count <= db->dirty_from || start >= db->dirty_to) &&
+            (start + SNAPSHOT_CHUNK_SIZE <= db->count ?
+                SNAPSHOT_CHUNK_SIZE : db->count - start) == prev->chunks[c]->count) {
+            chunk = prev->chunks[c];
+            platform_atomic_inc(&chunk->refs);
+        } else {
+            chunk = (RecordChunk*)malloc(sizeof(RecordChunk));
+            if (chunk == NULL) {
+                fprintf(stderr, "Ошибка выделения памяти для версии БД\n");
+                next->chunk_count = c;
+                db_snapshot_release(next);
+                return 0;
+            }
+            chunk->refs = 1;
+            chunk->count = db->count - start;
+            if (chunk->count > SNAPSHOT_CHUNK_SIZE) {
+                chunk->count = SNAPSHOT_CHUNK_SIZE;
+            }
+            memcpy(chunk->records, &db->records[start], chunk->count * sizeof(Repository));
+            memcpy(chunk->dead, &db->dead[start], chunk->count);
+        }
+        
+        next->chunks[c] = chunk;
+    }
+    next->chunk_count = chunk_count;
+    
+    platform_mutex_lock(&db->snapshot_lock);
+    db->snapshot = next;
+    platform_mutex_unlock(&db->snapshot_lock);
+    
+    db->dirty_from = INT_MAX;
+    db->dirty_to = 0;
+    
+    if (prev != NULL) {
+        db_snapshot_release(prev);
+    }
+    return 1;
+}
+
+DBSnapshot* db_snapshot_acquire(RepositoryDB* db)
+{
+    DBSnapshot* snapshot;
+    
+    if (db == NULL) {
+        return NULL;
+    }
+    
+    platform_mutex_lock(&db->snapshot_lock);
+    snapshot = db->snapshot;
+    if (snapshot != NULL) {
+        platform_atomic_inc(&snapshot->refs);
+    }
+    platform_mutex_unlock(&db->snapshot_lock);
+    
+    return snapshot;
+}
+
+int db_snapshot_release(DBSnapshot* snapshot)
+{
+    int c;
+    
+    if (snapshot == NULL) {
+        return 0;
+    }
+    
+    if (platform_atomic_dec(&snapshot->refs) != 0) {
+        return 1;
+    }
+    
+    for (c = 0; c < snapshot->chunk_count; c++) {
+        chunk_release(snapshot->chunks[c]);
+    }
+    free(snapshot->chunks);
+    free(snapshot);
+    return 1;
+}
+
+/* Запись по индексу; для удалённой записи возвращается NULL */
+const Repository* snapshot_record(const DBSnapshot* snapshot, int index)
+{
+    RecordChunk* chunk;
+    
+    if (snapshot == NULL || index < 0 || index >= snapshot->count) {
+        return NULL;
+    }
+    
+    chunk = snapshot->chunks[index / SNAPSHOT_CHUNK_SIZE];
+    if (chunk->dead[index % SNAPSHOT_CHUNK_SIZE]) {
+        return NULL;
+    }
+    return &chunk->records[index % SNAPSHOT_CHUNK_SIZE];
+}
+
+/*
+ * Нагрузочная проверка версий: писатель переносит единицу зависимостей между
+ * записями разных кусков, добавляет, удаляет и уплотняет записи, а читатели
+ * проверяют каждую полученную версию. Сумма зависимостей живых записей
+ * постоянна, название записи повторяет её размер и зависимости: версия,
+ * собранная из кусков разных публикаций, или разорванная запись нарушают
+ * одно из этих условий. Запускать в сборке с -fsanitize=thread.
+ */
+#define STRESS_LAST_SIZE 1000000000  /* размер последней записи - знак конца проверки */
+
+typedef struct {
+    RepositoryDB* db;
+    long long total;
+    unsigned long last_version;
+    int checked;
+    int errors;
+} StressReader;
+
+static void stress_fill(Repository* record, int size, int dependencies)
+{
+    memset(record, 0, sizeof(Repository));
+    record->direction = (Direction)(size % DIRECTION_COUNT);
+    record->compatibility = (Compatibility)(size % COMPAT_COUNT);
+    record->size = size;
+    record->dependencies = dependencies;
+    record->release_date.day = 1;
+    record->release_date.month = 1;
+    record->release_date.year = 2000 + size % 25;
+    sprintf(record->site, "https://stress.local/%d", size);
+    sprintf(record->name, "stress-%d-%d", size, dependencies);
+}
+
+static int stress_error(StressReader* reader, unsigned long version, const char* message)
+{
+    if (reader->errors++ < 5) {
+        fprintf(stderr, "Ошибка в версии %lu: %s\n", version, message);
+    }
+    return 0;
+}
+
+/* 1 - версия согласована; *finished - писатель опубликовал последнюю версию */
+static int stress_check(StressReader* reader, const DBSnapshot* snapshot, int* finished)
+{
+    const Repository* record;
+    char name[MAX_LONG_STR];
+    long long sum = 0;
+    int count = 0;
+    int c, i;
+    
+    if (snapshot->version < reader->last_version) {
+        return stress_error(reader, snapshot->version, "версия старее уже прочитанной");
+    }
+    reader->last_version = snapshot->version;
+    
+    for (c = 0; c < snapshot->chunk_count; c++) {
+        count += snapshot->chunks[c]->count;
+    }
+    if (count != snapshot->count) {
+        return stress_error(reader, snapshot->version, "размеры кусков не совпадают с числом записей");
+    }
+    
+    for (i = 0; i < snapshot->count; i++) {
+        record = snapshot_record(snapshot, i);
+        if (record == NULL) {
+            continue;
+        }
+        sprintf(name, "stress-%d-%d", record->size, record->dependencies);
+        if (strcmp(name, record->name) != 0) {
+            return stress_error(reader, snapshot->version, "запись разорвана");
+        }
+        sum += record->dependencies;
+    }
+    if (sum != reader->total) {
+        return stress_error(reader, snapshot->version, "версия собрана из разных публикаций");
+    }
+    
+    record = snapshot_record(snapshot, snapshot->count - 1);
+    *finished = record != NULL && record->size == STRESS_LAST_SIZE;
+    return 1;
+}
+
+static int stress_reader(void* arg)
+{
+    StressReader* reader = (StressReader*)arg;
+    DBSnapshot* snapshot;
+    int finished = 0;
+    
+    while (!finished) {
+        snapshot = db_snapshot_acquire(reader->db);
+        if (!stress_check(reader, snapshot, &finished)) {
+            finished = reader->errors > 100;
+        }
+        reader->checked++;
+        db_snapshot_release(snapshot);
+    }
+    return 1;
+}
+
+/* Перенести единицу зависимостей из from в to одной публикацией */
+static int stress_transfer(RepositoryDB* db, int from, int to)
+{
+    Repository* a = &db->records[from];
+    Repository* b = &db->records[to];
+    
+    stress_fill(a, a->size, a->dependencies - 1);
+    stress_fill(b, b->size, b->dependencies + 1);
+    if (!db_zone_include(db, from) || !db_zone_include(db, to)) {
+        return 0;
+    }
+    db_mark_changed(db, from);
+    db_mark_changed(db, to);
+    return db_publish(db);
+}
+
+int snapshot_stress_test(int reader_count, int rounds)
+{
+    RepositoryDB db;
+    Repository record;
+    StressReader* readers;
+    platform_thread* threads;
+    unsigned long seed = 12345;
+    int started = 0;
+    int errors = 0;
+    int checked = 0;
+    int from, to;
+    int ok = 1;
+    int r, t;
+    
+    if (reader_count <= 0 || rounds <= 0) {
+        fprintf(stderr, "Ошибка: некорректные параметры в snapshot_stress_test\n");
+        return 0;
+    }
+    
+    if (!db_init(&db)) {
+        return 0;
+    }
+    for (r = 1; r <= 8 * SNAPSHOT_CHUNK_SIZE && ok; r++) {
+        stress_fill(&record, r, 4);
+        ok = db_add_record(&db, &record);
+    }
+    
+    readers = (StressReader*)calloc(reader_count, sizeof(StressReader));
+    threads = (platform_thread*)malloc(reader_count * sizeof(platform_thread));
+    if (!ok || readers == NULL || threads == NULL) {
+        fprintf(stderr, "Ошибка подготовки нагрузочной проверки\n");
+        free(readers);
+        free(threads);
+        db_free(&db);
+        return 0;
+    }
+    
+    for (t = 0; t < reader_count; t++) {
+        readers[t].db = &db;
+        readers[t].total = 4LL * 8 * SNAPSHOT_CHUNK_SIZE;
+        if (!platform_thread_create(&threads[t], stress_reader, &readers[t])) {
+            break;
+        }
+        started++;
+    }
+    
+    for (r = 0; r < rounds && ok; r++) {
+        seed = seed * 1103515245 + 12345;
+        from = (int)((seed >> 8) % db.count);
+        to = (from + SNAPSHOT_CHUNK_SIZE + (int)((seed >> 20) % SNAPSHOT_CHUNK_SIZE)) % db.count;
+        
+        if (!db.dead[from] && !db.dead[to] && db.records[from].dependencies > 0) {
+            ok = stress_transfer(&db, from, to);
+        } else if (!db.dead[from] && db.records[from].dependencies == 0) {
+            ok = db_delete_record(&db, from);
+        }
+        
+        if (ok && r % 4 == 0) {
+            stress_fill(&record, db.count + 1, 0);
+            ok = db_add_record(&db, &record);
+        }
+        if (ok && r % 256 == 255) {
+            ok = db_compact(&db);
+        }
+    }
+    
+    stress_fill(&record, STRESS_LAST_SIZE, 0);
+    if (!db_add_record(&db, &record)) {
+        fprintf(stderr, "Ошибка публикации последней версии\n");
+        ok = 0;
+    }
+    
+    for (t = 0; t < started; t++) {
+        platform_thread_join(threads[t]);
+        errors += readers[t].errors;
+        checked += readers[t].checked;
+    }
+    
+    printf("Потоков чтения: %d, публикаций: %lu, проверено версий: %d, ошибок: %d\n",
+           started, db.version, checked, errors);
+    
+    free(readers);
+    free(threads);
+    db_free(&db);
+    return ok && started == reader_count && errors == 0;
+}
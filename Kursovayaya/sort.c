@@ -0,0 +1,441 @@
+/**
+ * @file sort.c
+ * @brief База данных репозитория - сортировка по набору ключей
+ * @author Костопраев Дмитрий Евгеньевич
+ *
+ * Порядок задаётся списком ключей (поле, направление), например
+ * "size:desc,name". Для частых наборов ключей функция сравнения и
+ * сортировка слиянием порождаются макросами, так что сравнение полей
+ * встраивается в цикл сортировки. Остальные наборы сортируются общим
+ * вариантом, который перебирает ключи при каждом сравнении.
+ * Сортировка устойчива: записи с равными ключами сохраняют порядок.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "repository.h"
+
+/* Короткие отрезки упорядочиваются вставками до слияний */
+#define SORT_RUN 16
+
+const char* sort_field_keys[] = {
+    "name", "site", "direction", "size", "date", "deps", "compat"
+};
+
+typedef void (*SortFunc)(const Repository** items, const Repository** temp, int count,
+                         const SortSpec* spec);
+
+typedef struct {
+    SortKey keys[SORT_MAX_KEYS];
+    int count;
+    SortFunc sort;
+} SpecializedSort;
+
+/* Сравнение по одному полю: <0, 0, >0 */
+#define CMP_INT(x, y) (((x) > (y)) - ((x) < (y)))
+#define DATE_KEY(r) ((r)->release_date.year * 10000 + (r)->release_date.month * 100 + (r)->release_date.day)
+
+#define KEY_NAME(a, b) strcmp((a)->name, (b)->name)
+#define KEY_SITE(a, b) strcmp((a)->site, (b)->site)
+#define KEY_DIRECTION(a, b) CMP_INT((int)(a)->direction, (int)(b)->direction)
+#define KEY_SIZE(a, b) CMP_INT((a)->size, (b)->size)
+#define KEY_DATE(a, b) CMP_INT(DATE_KEY(a), DATE_KEY(b))
+#define KEY_DEPS(a, b) CMP_INT((a)->dependencies, (b)->dependencies)
+#define KEY_COMPAT(a, b) CMP_INT((int)(a)->compatibility, (int)(b)->compatibility)
+
+/*
+ * Устойчивая сортировка слиянием массива указателей: вставки по SORT_RUN,
+ * затем слияния снизу вверх с переменой ролей items и temp.
+ * CMP(x, y) - выражение сравнения двух записей.
+ */
+#define DEFINE_MERGE_SORT(fn, CMP)                                                          \
+static void fn(const Repository** items, const Repository** temp, int count,               \
+               const SortSpec* spec)                                                        \
+{                                                                                           \
+    const Repository** src = items;                                                         \
+    const Repository** dst = temp;                                                          \
+    const Repository** swap;                                                                \
+    const Repository* x;                                                                    \
+    int width, lo, mid, hi, i, j, k;                                                        \
+                                                                                            \
+    (void)spec;                                                                             \
+    for (lo = 0; lo < count; lo += SORT_RUN) {                                              \
+        hi = lo + SORT_RUN < count ? lo + SORT_RUN : count;                                 \
+        for (i = lo + 1; i < hi; i++) {                                                     \
+            x = src[i];                                                                     \
+            for (j = i; j > lo && CMP(x, src[j - 1]) < 0; j--) {                            \
+                src[j] = src[j - 1];                                                        \
+            }                                                                               \
+            src[j] = x;                                                                     \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    for (width = SORT_RUN; width < count; width *= 2) {                                     \
+        for (lo = 0; lo < count; lo += 2 * width) {                                         \
+            mid = lo + width < count ? lo + width : count;                                  \
+            hi = lo + 2 * width < count ? lo + 2 * width : count;                           \
+            i = lo;                                                                         \
+            j = mid;                                                                        \
+            k = lo;                                                                         \
+            while (i < mid && j < hi) {                                                     \
+                dst[k++] = CMP(src[j], src[i]) < 0 ? src[j++] : src[i++];                   \
+            }                                                                               \
+            while (i < mid) {                                                               \
+                dst[k++] = src[i++];                                                        \
+            }                                                                               \
+            while (j < hi) {                                                                \
+                dst[k++] = src[j++];                                                        \
+            }                                                                               \
+        }                                                                                   \
+        swap = src;                                                                         \
+        src = dst;                                                                          \
+        dst = swap;                                                                         \
+    }                                                                                       \
+                                                                                            \
+    if (src != items) {                                                                     \
+        memcpy(items, src, count * sizeof(*items));                                         \
+    }                                                                                       \
+}
+
+/* Специализированные сравнения: k1..k3 - выражения KEY_*(a, b) или KEY_*(b, a) для убывания */
+#define SORT_BY_1(name, k1)                                                                 \
+static int compare_##name(const Repository* a, const Repository* b)                         \
+{                                                                                           \
+    return k1;                                                                              \
+}                                                                                           \
+DEFINE_MERGE_SORT(sort_##name, compare_##name)
+
+#define SORT_BY_2(name, k1, k2)                                                             \
+static int compare_##name(const Repository* a, const Repository* b)                         \
+{                                                                                           \
+    int cmp = k1;                                                                           \
+    return cmp != 0 ? cmp : k2;                                                             \
+}                                                                                           \
+DEFINE_MERGE_SORT(sort_##name, compare_##name)
+
+#define SORT_BY_3(name, k1, k2, k3)                                                         \
+static int compare_##name(const Repository* a, const Repository* b)                         \
+{                                                                                           \
+    int cmp = k1;                                                                           \
+    if (cmp != 0) {                                                                         \
+        return cmp;                                                                         \
+    }                                                                                       \
+    cmp = k2;                                                                               \
+    return cmp != 0 ? cmp : k3;                                                             \
+}                                                                                           \
+DEFINE_MERGE_SORT(sort_##name, compare_##name)
+
+/* Один ключ в обоих направлениях */
+#define SORT_BY_FIELD(field, KEY)                                                           \
+SORT_BY_1(field##_asc, KEY(a, b))                                                           \
+SORT_BY_1(field##_desc, KEY(b, a))
+
+SORT_BY_FIELD(name, KEY_NAME)
+SORT_BY_FIELD(site, KEY_SITE)
+SORT_BY_FIELD(direction, KEY_DIRECTION)
+SORT_BY_FIELD(size, KEY_SIZE)
+SORT_BY_FIELD(date, KEY_DATE)
+SORT_BY_FIELD(deps, KEY_DEPS)
+SORT_BY_FIELD(compat, KEY_COMPAT)
+
+SORT_BY_2(size_desc_name, KEY_SIZE(b, a), KEY_NAME(a, b))
+SORT_BY_2(date_desc_name, KEY_DATE(b, a), KEY_NAME(a, b))
+SORT_BY_2(deps_date, KEY_DEPS(a, b), KEY_DATE(a, b))
+SORT_BY_2(deps_desc_size_desc, KEY_DEPS(b, a), KEY_SIZE(b, a))
+SORT_BY_2(compat_name, KEY_COMPAT(a, b), KEY_NAME(a, b))
+SORT_BY_2(direction_name, KEY_DIRECTION(a, b), KEY_NAME(a, b))
+SORT_BY_2(name_site, KEY_NAME(a, b), KEY_SITE(a, b))
+SORT_BY_3(direction_size_desc_name, KEY_DIRECTION(a, b), KEY_SIZE(b, a), KEY_NAME(a, b))
+SORT_BY_3(name_direction_date_desc, KEY_NAME(a, b), KEY_DIRECTION(a, b), KEY_DATE(b, a))
+
+static const SpecializedSort specialized[] = {
+    { { { SORT_NAME, 0 } }, 1, sort_name_asc },
+    { { { SORT_NAME, 1 } }, 1, sort_name_desc },
+    { { { SORT_SITE, 0 } }, 1, sort_site_asc },
+    { { { SORT_SITE, 1 } }, 1, sort_site_desc },
+    { { { SORT_DIRECTION, 0 } }, 1, sort_direction_asc },
+    { { { SORT_DIRECTION, 1 } }, 1, sort_direction_desc },
+    { { { SORT_SIZE, 0 } }, 1, sort_size_asc },
+    { { { SORT_SIZE, 1 } }, 1, sort_size_desc },
+    { { { SORT_DATE, 0 } }, 1, sort_date_asc },
+    { { { SORT_DATE, 1 } }, 1, sort_date_desc },
+    { { { SORT_DEPENDENCIES, 0 } }, 1, sort_deps_asc },
+    { { { SORT_DEPENDENCIES, 1 } }, 1, sort_deps_desc },
+    { { { SORT_COMPATIBILITY, 0 } }, 1, sort_compat_asc },
+    { { { SORT_COMPATIBILITY, 1 } }, 1, sort_compat_desc },
+    { { { SORT_SIZE, 1 }, { SORT_NAME, 0 } }, 2, sort_size_desc_name },
+    { { { SORT_DATE, 1 }, { SORT_NAME, 0 } }, 2, sort_date_desc_name },
+    { { { SORT_DEPENDENCIES, 0 }, { SORT_DATE, 0 } }, 2, sort_deps_date },
+    { { { SORT_DEPENDENCIES, 1 }, { SORT_SIZE, 1 } }, 2, sort_deps_desc_size_desc },
+    { { { SORT_COMPATIBILITY, 0 }, { SORT_NAME, 0 } }, 2, sort_compat_name },
+    { { { SORT_DIRECTION, 0 }, { SORT_NAME, 0 } }, 2, sort_direction_name },
+    { { { SORT_NAME, 0 }, { SORT_SITE, 0 } }, 2, sort_name_site },
+    { { { SORT_DIRECTION, 0 }, { SORT_SIZE, 1 }, { SORT_NAME, 0 } }, 3, sort_direction_size_desc_name },
+    { { { SORT_NAME, 0 }, { SORT_DIRECTION, 0 }, { SORT_DATE, 1 } }, 3, sort_name_direction_date_desc }
+};
+
+/* Общий вариант: ключи перебираются при каждом сравнении */
+static int compare_by_spec(const Repository* a, const Repository* b, const SortSpec* spec)
+{
+    int cmp = 0;
+    int k;
+    
+    for (k = 0; k < spec->count; k++) {
+        switch (spec->keys[k].field) {
+            case SORT_NAME:
+                cmp = KEY_NAME(a, b);
+                break;
+            case SORT_SITE:
+                cmp = KEY_SITE(a, b);
+                break;
+            case SORT_DIRECTION:
+                cmp = KEY_DIRECTION(a, b);
+                break;
+            case SORT_SIZE:
+                cmp = KEY_SIZE(a, b);
+                break;
+            case SORT_DATE:
+                cmp = KEY_DATE(a, b);
+                break;
+            case SORT_DEPENDENCIES:
+                cmp = KEY_DEPS(a, b);
+                break;
+            case SORT_COMPATIBILITY:
+                cmp = KEY_COMPAT(a, b);
+                break;
+            default:
+                cmp = 0;
+                break;
+        }
+        if (cmp != 0) {
+            return spec->keys[k].descending ? -cmp : cmp;
+        }
+    }
+    return 0;
+}
+
+#define COMPARE_BY_SPEC(x, y) compare_by_spec(x, y, spec)
+DEFINE_MERGE_SORT(sort_generic, COMPARE_BY_SPEC)
+
+/* Специализированная сортировка для набора ключей или NULL */
+static SortFunc find_specialized(const SortSpec* spec)
+{
+    int s, k;
+    
+    for (s = 0; s < (int)(sizeof(specialized) / sizeof(specialized[0])); s++) {
+        if (specialized[s].count != spec->count) {
+            continue;
+        }
+        for (k = 0; k < spec->count; k++) {
+            if (specialized[s].keys[k].field != spec->keys[k].field ||
+                specialized[s].keys[k].descending != spec->keys[k].descending) {
+                break;
+            }
+        }
+        if (k == spec->count) {
+            return specialized[s].sort;
+        }
+    }
+    return NULL;
+}
+
+/* Разобрать "поле[:asc|:desc],..." в набор ключей */
+int sort_spec_parse(const char* text, SortSpec* spec)
+{
+    char token[MAX_STR];
+    const char* end;
+    char* colon;
+    size_t length;
+    int f;
+    
+    if (text == NULL || spec == NULL) {
+        fprintf(stderr, "Ошибка: некорректные параметры в sort_spec_parse\n");
+        return 0;
+    }
+    
+    spec->count = 0;
+    while (1) {
+        end = strchr(text, ',');
+        length = end != NULL ? (size_t)(end - text) : strlen(text);
+        if (length == 0 || length >= sizeof(token)) {
+            fprintf(stderr, "Ошибка: пустой или слишком длинный ключ сортировки\n");
+            return 0;
+        }
+        if (spec->count == SORT_MAX_KEYS) {
+            fprintf(stderr, "Ошибка: не больше %d ключей сортировки\n", SORT_MAX_KEYS);
+            return 0;
+        }
+        
+        memcpy(token, text, length);
+        token[length] = '\0';
+        spec->keys[spec->count].descending = 0;
+        colon = strchr(token, ':');
+        if (colon != NULL) {
+            *colon++ = '\0';
+            if (strcmp(colon, "desc") == 0) {
+                spec->keys[spec->count].descending = 1;
+            } else if (strcmp(colon, "asc") != 0) {
+                fprintf(stderr, "Ошибка: направление '%s', ожидается asc или desc\n", colon);
+                return 0;
+            }
+        }
+        
+        f = 0;
+        while (f < SORT_FIELD_COUNT && strcmp(token, sort_field_keys[f]) != 0) {
+            f++;
+        }
+        if (f == SORT_FIELD_COUNT) {
+            fprintf(stderr, "Ошибка: неизвестное поле сортировки '%s'\n", token);
+            return 0;
+        }
+        spec->keys[spec->count++].field = (SortField)f;
+        
+        if (end == NULL) {
+            return 1;
+        }
+        text = end + 1;
+    }
+}
+
+/* Массив указателей на живые записи и буфер для слияний */
+static const Repository** sort_items(RepositoryDB* db, const Repository*** temp)
+{
+    const Repository** items;
+    int i;
+    
+    items = (const Repository**)malloc(db->count * sizeof(Repository*));
+    *temp = (const Repository**)malloc(db->count * sizeof(Repository*));
+    if (items == NULL || *temp == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для сортировки\n");
+        free(items);
+        free(*temp);
+        return NULL;
+    }
+    
+    for (i = 0; i < db->count; i++) {
+        items[i] = &db->records[i];
+    }
+    return items;
+}
+
+/* Упорядочить записи по набору ключей и опубликовать новую версию */
+int db_sort(RepositoryDB* db, const SortSpec* spec)
+{
+    const Repository** items;
+    const Repository** temp;
+    Repository* sorted;
+    SortFunc sort;
+    int i;
+    
+    if (db == NULL || spec == NULL || spec->count <= 0 || spec->count > SORT_MAX_KEYS) {
+        fprintf(stderr, "Ошибка: некорректные параметры в db_sort\n");
+        return 0;
+    }
+    
+    if (db->dead_count > 0 && !db_compact(db)) {
+        return 0;
+    }
+    
+    if (db->count < 2) {
+        return 1;
+    }
+    
+    sort = find_specialized(spec);
+    if (sort == NULL) {
+        sort = sort_generic;
+    }
+    
+    items = sort_items(db, &temp);
+    if (items == NULL) {
+        return 0;
+    }
+    sort(items, temp, db->count, spec);
+    
+    sorted = (Repository*)malloc(db->capacity * sizeof(Repository));
+    if (sorted == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для сортировки\n");
+        free(items);
+        free(temp);
+        return 0;
+    }
+    for (i = 0; i < db->count; i++) {
+        sorted[i] = *items[i];
+    }
+    free(items);
+    free(temp);
+    
+    return db_replace_records(db, sorted, db->count, db->capacity, NULL, 0, db->sketches);
+}
+
+/* Среднее время rounds сортировок копий items в миллисекундах */
+static double time_sort(SortFunc sort, const Repository** items, const Repository** work,
+                        const Repository** temp, int count, const SortSpec* spec, int rounds)
+{
+    double start;
+    int r;
+    
+    start = platform_time_ms();
+    for (r = 0; r < rounds; r++) {
+        memcpy(work, items, count * sizeof(*items));
+        sort(work, temp, count, spec);
+    }
+    return (platform_time_ms() - start) / rounds;
+}
+
+/*
+ * Сравнить специализированную и общую сортировку на записях БД без их
+ * изменения. Порядок результатов обеих проверяется на совпадение.
+ */
+int sort_benchmark(RepositoryDB* db, const SortSpec* spec, int rounds)
+{
+    const Repository** items;
+    const Repository** temp;
+    const Repository** work;
+    const Repository** check;
+    SortFunc sort;
+    double generic_ms;
+    double specialized_ms;
+    int ok = 1;
+    
+    if (db == NULL || spec == NULL || spec->count <= 0 || rounds <= 0 || db->count < 2) {
+        fprintf(stderr, "Ошибка: некорректные параметры в sort_benchmark\n");
+        return 0;
+    }
+    
+    items = sort_items(db, &temp);
+    work = (const Repository**)malloc(db->count * sizeof(Repository*));
+    check = (const Repository**)malloc(db->count * sizeof(Repository*));
+    if (items == NULL || work == NULL || check == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для сортировки\n");
+        if (items != NULL) {
+            free(items);
+            free(temp);
+        }
+        free(work);
+        free(check);
+        return 0;
+    }
+    
+    generic_ms = time_sort(sort_generic, items, check, temp, db->count, spec, rounds);
+    printf("Общее сравнение:           %.2f мс\n", generic_ms);
+    
+    sort = find_specialized(spec);
+    if (sort == NULL) {
+        printf("Специализированного сравнения для этих ключей нет\n");
+    } else {
+        specialized_ms = time_sort(sort, items, work, temp, db->count, spec, rounds);
+        printf("Специализированное:        %.2f мс (в %.2f раза быстрее)\n",
+            specialized_ms, specialized_ms > 0 ? generic_ms / specialized_ms : 0.0);
+        if (memcmp(work, check, db->count * sizeof(*work)) != 0) {
+            fprintf(stderr, "Ошибка: порядок специализированной и общей сортировки различается\n");
+            ok = 0;
+        }
+    }
+    
+    free(items);
+    free(temp);
+    free(work);
+    free(check);
+    return ok;
+}
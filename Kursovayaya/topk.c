@@ -0,0 +1,290 @@
+/**
+ * @file topk.c
+ * @brief База данных репозитория - K лучших записей по числовому полю
+ * @author Костопраев Дмитрий Евгеньевич
+ *
+ * Вместо полной сортировки просмотр держит кучу из K лучших записей, в корне
+ * которой худшая из них: O(n log K). Заполненная куча позволяет пропускать
+ * блоки, зона которых не может превзойти корень. Параллельный вариант делит
+ * блоки между потоками и сливает их кучи.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "repository.h"
+
+typedef struct {
+    int value;
+    int index;
+} TopKEntry;
+
+typedef struct {
+    TopKEntry* items;
+    int count;
+    int k;
+    int descending;
+} TopKHeap;
+
+typedef struct {
+    RepositoryDB* db;
+    const TopKQuery* query;
+    int first_zone;
+    int last_zone;
+    TopKHeap heap;
+} TopKTask;
+
+/* a хуже b: при равных значениях хуже запись с большим номером */
+static int entry_worse(const TopKHeap* heap, const TopKEntry* a, const TopKEntry* b)
+{
+    if (a->value != b->value) {
+        return heap->descending ? a->value < b->value : a->value > b->value;
+    }
+    return a->index > b->index;
+}
+
+static void entry_swap(TopKEntry* a, TopKEntry* b)
+{
+    TopKEntry temp = *a;
+    
+    *a = *b;
+    *b = temp;
+}
+
+static void heap_sift_up(TopKHeap* heap, int pos)
+{
+    int parent;
+    
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (!entry_worse(heap, &heap->items[pos], &heap->items[parent])) {
+            break;
+        }
+        entry_swap(&heap->items[pos], &heap->items[parent]);
+        pos = parent;
+    }
+}
+
+static void heap_sift_down(TopKHeap* heap, int pos)
+{
+    int child;
+    
+    while ((child = 2 * pos + 1) < heap->count) {
+        if (child + 1 < heap->count &&
+            entry_worse(heap, &heap->items[child + 1], &heap->items[child])) {
+            child++;
+        }
+        if (!entry_worse(heap, &heap->items[child], &heap->items[pos])) {
+            break;
+        }
+        entry_swap(&heap->items[pos], &heap->items[child]);
+        pos = child;
+    }
+}
+
+static int heap_init(TopKHeap* heap, int k, int descending)
+{
+    heap->items = (TopKEntry*)malloc(k * sizeof(TopKEntry));
+    if (heap->items == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для выборки K лучших\n");
+        return 0;
+    }
+    
+    heap->count = 0;
+    heap->k = k;
+    heap->descending = descending;
+    return 1;
+}
+
+/* Предложить запись: она попадает в кучу, если лучше худшей из K */
+static void heap_offer(TopKHeap* heap, int value, int index)
+{
+    TopKEntry entry;
+    
+    entry.value = value;
+    entry.index = index;
+    
+    if (heap->count < heap->k) {
+        heap->items[heap->count++] = entry;
+        heap_sift_up(heap, heap->count - 1);
+    } else if (entry_worse(heap, &heap->items[0], &entry)) {
+        heap->items[0] = entry;
+        heap_sift_down(heap, 0);
+    }
+}
+
+/* Блок можно пропустить, если ни одна его запись не лучше корня заполненной кучи */
+static int heap_excludes_zone(const TopKHeap* heap, const ZoneMap* zone, NumericField field)
+{
+    if (heap->count < heap->k) {
+        return 0;
+    }
+    
+    return heap->descending ? zone->max[field] < heap->items[0].value
+                            : zone->min[field] > heap->items[0].value;
+}
+
+static int record_matches(const Repository* record, const TopKQuery* query)
+{
+    return (query->direction < 0 || (int)record->direction == query->direction) &&
+           (query->compatibility < 0 || (int)record->compatibility == query->compatibility);
+}
+
+static void scan_zones(RepositoryDB* db, const TopKQuery* query, TopKHeap* heap,
+                       int first_zone, int last_zone)
+{
+    const ZoneMap* zone;
+    int end;
+    int z, i;
+    
+    for (z = first_zone; z < last_zone; z++) {
+        zone = &db->zones[z];
+        if ((query->direction >= 0 && !(zone->direction_mask & (1 << query->direction))) ||
+            (query->compatibility >= 0 && !(zone->compat_mask & (1 << query->compatibility))) ||
+            heap_excludes_zone(heap, zone, query->field)) {
+            continue;
+        }
+        
+        end = (z + 1) * ZONE_BLOCK_SIZE < db->count ? (z + 1) * ZONE_BLOCK_SIZE : db->count;
+        for (i = z * ZONE_BLOCK_SIZE; i < end; i++) {
+            if (!db->dead[i] && record_matches(&db->records[i], query)) {
+                heap_offer(heap, record_field_value(&db->records[i], query->field), i);
+            }
+        }
+    }
+}
+
+/* Извлечь кучу в результат: лучшая запись первой */
+static SearchResult heap_to_result(TopKHeap* heap)
+{
+    SearchResult result = { NULL, 0, NULL };
+    int n = heap->count;
+    
+    if (n == 0) {
+        return result;
+    }
+    
+    result.indices = (int*)malloc(n * sizeof(int));
+    if (result.indices == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для результатов\n");
+        return result;
+    }
+    
+    while (heap->count > 0) {
+        result.indices[heap->count - 1] = heap->items[0].index;
+        heap->items[0] = heap->items[--heap->count];
+        heap_sift_down(heap, 0);
+    }
+    result.count = n;
+    return result;
+}
+
+static int check_query(RepositoryDB* db, const TopKQuery* query)
+{
+    if (db == NULL || query == NULL || query->field < 0 || query->field >= FIELD_COUNT ||
+        query->k <= 0 || query->direction >= DIRECTION_COUNT ||
+        query->compatibility >= COMPAT_COUNT) {
+        fprintf(stderr, "Ошибка: некорректные параметры выборки K лучших\n");
+        return 0;
+    }
+    
+    return 1;
+}
+
+SearchResult db_top_k(RepositoryDB* db, const TopKQuery* query)
+{
+    SearchResult result = { NULL, 0, NULL };
+    TopKHeap heap;
+    
+    if (!check_query(db, query) || db->count == 0) {
+        return result;
+    }
+    
+    if (!heap_init(&heap, query->k < db->count ? query->k : db->count, query->descending)) {
+        return result;
+    }
+    
+    scan_zones(db, query, &heap, 0, db->zone_count);
+    result = heap_to_result(&heap);
+    free(heap.items);
+    return result;
+}
+
+static int top_k_worker(void* arg)
+{
+    TopKTask* task = (TopKTask*)arg;
+    
+    scan_zones(task->db, task->query, &task->heap, task->first_zone, task->last_zone);
+    return 1;
+}
+
+/*
+ * Каждый поток выбирает K лучших в своей полосе блоков, затем кучи сливаются.
+ * Порядок (значение, номер) полный, поэтому результат совпадает с db_top_k.
+ */
+SearchResult db_top_k_parallel(RepositoryDB* db, const TopKQuery* query, int thread_count)
+{
+    SearchResult result = { NULL, 0, NULL };
+    platform_thread* threads;
+    TopKTask* tasks;
+    TopKHeap merged;
+    int k;
+    int started = 0;
+    int per_thread;
+    int t, i;
+    
+    if (!check_query(db, query) || db->count == 0) {
+        return result;
+    }
+    
+    if (thread_count > db->zone_count) {
+        thread_count = db->zone_count;
+    }
+    if (thread_count <= 1 || db->count < TOPK_PARALLEL_MIN_RECORDS) {
+        return db_top_k(db, query);
+    }
+    
+    k = query->k < db->count ? query->k : db->count;
+    threads = (platform_thread*)malloc(thread_count * sizeof(platform_thread));
+    tasks = (TopKTask*)calloc(thread_count, sizeof(TopKTask));
+    if (threads == NULL || tasks == NULL || !heap_init(&merged, k, query->descending)) {
+        fprintf(stderr, "Ошибка выделения памяти для выборки K лучших\n");
+        free(threads);
+        free(tasks);
+        return result;
+    }
+    
+    per_thread = (db->zone_count + thread_count - 1) / thread_count;
+    for (t = 0; t < thread_count; t++) {
+        tasks[t].db = db;
+        tasks[t].query = query;
+        tasks[t].first_zone = t * per_thread;
+        tasks[t].last_zone = (t + 1) * per_thread < db->zone_count ? (t + 1) * per_thread : db->zone_count;
+        if (!heap_init(&tasks[t].heap, k, query->descending)) {
+            break;
+        }
+        if (!platform_thread_create(&threads[t], top_k_worker, &tasks[t])) {
+            free(tasks[t].heap.items);
+            break;
+        }
+        started++;
+    }
+    
+    /* Полосы незапущенных потоков просматриваются в текущем */
+    if (started < thread_count) {
+        scan_zones(db, query, &merged, tasks[started].first_zone, db->zone_count);
+    }
+    
+    for (t = 0; t < started; t++) {
+        platform_thread_join(threads[t]);
+        for (i = 0; i < tasks[t].heap.count; i++) {
+            heap_offer(&merged, tasks[t].heap.items[i].value, tasks[t].heap.items[i].index);
+        }
+        free(tasks[t].heap.items);
+    }
+    
+    result = heap_to_result(&merged);
+    free(merged.items);
+    free(threads);
+    free(tasks);
+    return result;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file zonemap.c
+ * @brief База данных репозитория - зоны min/max для пропуска блоков при поиске
+ * @author Костопраев Дмитрий Евгеньевич
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "repository.h"
+
+const char* field_names[] = {
+    "Размер", "Дата релиза", "Зависимости"
+};
+
+/* Дата как число ГГГГММДД: порядок чисел совпадает с compare_dates */
+int date_to_key(Date date)
+{
+    return date.year * 10000 + date.month * 100 + date.day;
+}
+
+int record_field_value(const Repository* record, NumericField field)
+{
+    switch (field) {
+        case FIELD_SIZE:
+            return record->size;
+        case FIELD_RELEASE_DATE:
+            return date_to_key(record->release_date);
+        case FIELD_DEPENDENCIES:
+            return record->dependencies;
+        default:
+            return 0;
+    }
+}
+
+static void zone_reset(ZoneMap* zone)
+{
+    int f;
+    
+    for (f = 0; f < FIELD_COUNT; f++) {
+        zone->min[f] = INT_MAX;
+        zone->max[f] = INT_MIN;
+    }
+    zone->direction_mask = 0;
+    zone->compat_mask = 0;
+}
+
+static void zone_extend(ZoneMap* zone, const Repository* record)
+{
+    int value;
+    int f;
+    
+    for (f = 0; f < FIELD_COUNT; f++) {
+        value = record_field_value(record, (NumericField)f);
+        if (value < zone->min[f]) {
+            zone->min[f] = value;
+        }
+        if (value > zone->max[f]) {
+            zone->max[f] = value;
+        }
+    }
+    zone->direction_mask |= (unsigned char)(1 << record->direction);
+    zone->compat_mask |= (unsigned char)(1 << record->compatibility);
+}
+
+static int zones_reserve(RepositoryDB* db, int zone_count)
+{
+    ZoneMap* temp;
+    int new_capacity;
+    
+    if (zone_count <= db->zone_capacity) {
+        return 1;
+    }
+    
+    new_capacity = db->zone_capacity > 0 ? db->zone_capacity : INITIAL_CAPACITY;
+    while (new_capacity < zone_count) {
+        new_capacity *= 2;
+    }
+    
+    temp = (ZoneMap*)realloc(db->zones, new_capacity * sizeof(ZoneMap));
+    if (temp == NULL) {
+        fprintf(stderr, "Ошибка выделения памяти для зон поиска\n");
+        return 0;
+    }
+    
+    db->zones = temp;
+    db->zone_capacity = new_capacity;
+    return 1;
+}
+
+/* Учесть запись index в зоне её блока; новые блоки заводятся по мере роста */
+int db_zone_include(RepositoryDB* db, int index)
+{
+    int block = index / ZONE_BLOCK_SIZE;
+    
+    if (!zones_reserve(db, block + 1)) {
+        return 0;
+    }
+    
+    while (db->zone_count <= block) {
+        zone_reset(&db->zones[db->zone_count]);
+        db->zone_count++;
+    }
+    
+    zone_extend(&db->zones[block], &db->records[index]);
+    return 1;
+}
+
+/* Пересчитать все зоны после перестановки записей */
+int db_rebuild_zones(RepositoryDB* db)
+{
+    int i;
+    
+    if (db == NULL) {
+        return 0;
+    }
+    
+    db->zone_count = 0;
+    for (i = 0; i < db->count; i++) {
+        if (!db_zone_include(db, i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Установить готовые зоны (например, из архива) вместо пересчёта */
+int db_set_zones(RepositoryDB* db, const ZoneMap* zones, int zone_count)
+{
+    if (db == NULL || zones == NULL ||
+        zone_count != (db->count + ZONE_BLOCK_SIZE - 1) / ZONE_BLOCK_SIZE) {
+        return 0;
+    }
+    
+    if (!zones_reserve(db, zone_count)) {
+        return 0;
+    }
+    
+    memcpy(db->zones, zones, zone_count * sizeof(ZoneMap));
+    db->zone_count = zone_count;
+    return 1;
+}
+
+/* Зона для произвольного набора записей, не привязанного к БД */
+int zone_build(ZoneMap* zone, const Repository* records, int count)
+{
+    int i;
+    
+    if (zone == NULL || (records == NULL && count > 0)) {
+        return 0;
+    }
+    
+    zone_reset(zone);
+    for (i = 0; i < count; i++) {
+        zone_extend(zone, &records[i]);
+    }
+    return 1;
+}
+
+/* Может ли в блоке быть значение поля из [min_value, max_value] */
+int zone_may_contain(const ZoneMap* zone, NumericField field, int min_value, int max_value)
+{
+    return zone->max[field] >= min_value && zone->min[field] <= max_value;
+}